@@ -0,0 +1,163 @@
+#include "automaton_cache.h"
+
+#include "regex.h"
+#include "regex_tree.h"
+
+namespace
+{
+
+/**
+ * The text of a rule as parsed: the same symbols written differently, such
+ * as `a` and `\a`, give the same key, while the operators and the escaped
+ * characters they are written as do not.
+ */
+std::string normalize(const std::string& rule)
+{
+	Regex regex(rule);
+
+	std::string result;
+	for (const auto& symbol : regex.symbols())
+	{
+		if (symbol.is_char()) result += 'c';
+		else if (symbol.is_range()) result += 'r';
+		else if (symbol.is_code_point_range()) result += 'p';
+		else if (symbol.is_class()) result += 'k';
+		else if (symbol.is_repeat()) result += '{';
+		else if (symbol.is_end_marker()) result += '#';
+		else if (symbol.is_epsilon()) result += 'e';
+
+		auto text = symbol.to_string();
+		result += std::to_string(text.length()) + ':' + text;
+	}
+	return result;
+}
+
+/**
+ * Append a number to a binary key.
+ */
+void append_number(std::string& key, std::uint64_t value)
+{
+	key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}
+
+std::shared_ptr<const DFA> AutomatonCache::dfa(const std::vector<std::string>& rules)
+{
+	if (rules.empty()) return nullptr;
+
+	std::vector<cached_type> rule_dfas;
+	for (const auto& rule : rules)
+	{
+		rule_dfas.emplace_back(cached_rule(rule));
+	}
+
+	std::size_t size = 1;
+	while (size < rules.size()) size *= 2;
+
+	return unite(rule_dfas, 0, rules.size(), size);
+}
+
+std::shared_ptr<const DFA> AutomatonCache::rule_dfa(const std::string& rule)
+{
+	return cached_rule(rule).first;
+}
+
+AutomatonCache::cached_type AutomatonCache::cached_rule(const std::string& rule)
+{
+	auto key = 'r' + normalize(rule);
+
+	auto cached = find(key);
+	if (cached.first) return cached;
+
+	// The rule is built without the lock, the other threads do not wait
+	// for it
+	auto rule_dfa = std::make_shared<DFA>(AugmentedRegexTree(AugmentedRegex(rule)));
+	rule_dfa->minimize();
+
+	return insert(key, rule_dfa);
+}
+
+AutomatonCache::dfa_ptr AutomatonCache::unite(const std::vector<cached_type>& rules,
+                                              std::size_t first,
+                                              std::size_t last,
+                                              std::size_t size)
+{
+	// The right half of the range is past the rules
+	while (size > 1 && first + size / 2 >= last) size /= 2;
+
+	// A union is identified by its first token id and its rules
+	std::string key(1, 'u');
+	append_number(key, first);
+	for (auto i = first; i < last; ++i)
+	{
+		append_number(key, rules[i].second);
+	}
+
+	auto cached = find(key);
+	if (cached.first) return cached.first;
+
+	std::shared_ptr<DFA> result;
+	if (size == 1)
+	{
+		result = std::make_shared<DFA>(*rules[first].first);
+		result->remap_tokens({static_cast<int>(first)});
+	}
+	else
+	{
+		auto half = first + size / 2;
+		result = std::make_shared<DFA>(*unite(rules, first, half, size / 2),
+		                               *unite(rules, half, last, size / 2));
+	}
+
+	return insert(key, result).first;
+}
+
+AutomatonCache::cached_type AutomatonCache::find(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _index.find(key);
+	if (it == _index.end()) return cached_type();
+
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return cached_type(it->second->dfa, it->second->serial);
+}
+
+AutomatonCache::cached_type AutomatonCache::insert(const std::string& key, const dfa_ptr& dfa)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _index.find(key);
+	if (it != _index.end())
+	{
+		return cached_type(it->second->dfa, it->second->serial);
+	}
+
+	auto bytes = dfa->states_bytes() + key.capacity();
+	_entries.push_front(Entry{key, dfa, bytes, _next_serial++});
+	_index.emplace(key, _entries.begin());
+	_bytes += bytes;
+
+	// The new automaton is kept even if it exceeds the budget alone
+	while (_bytes > _max_bytes && _entries.size() > 1)
+	{
+		_bytes -= _entries.back().bytes;
+		_index.erase(_entries.back().key);
+		_entries.pop_back();
+	}
+
+	return cached_type(dfa, _entries.front().serial);
+}
+
+std::size_t AutomatonCache::memory_bytes() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _bytes;
+}
+
+std::size_t AutomatonCache::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries.size();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <limits>
+#include <cstdint>
+
+#include "dfa.h"
+
+/**
+ * A cache of the automata of rule sets sharing most of their rules, such as
+ * the dialects of a language. The DFA of each rule is built once, keyed by
+ * its normalized text, whatever rule sets it belongs to. The DFA of a rule
+ * set is the union of the DFAs of its rules, made over aligned ranges of
+ * rules as in a segment tree, and each union is kept too. A rule set
+ * differing from a cached one by a few rules only rebuilds the unions of
+ * the ranges holding them.
+ *
+ * The least recently used automata are dropped once the cache exceeds its
+ * memory budget, those still in use are kept alive by their owners.
+ */
+class AutomatonCache
+{
+public:
+	/**
+	 * @param max_bytes the memory budget of the cache, as counted by
+	 *                  DFA::states_bytes()
+	 */
+	explicit AutomatonCache(std::size_t max_bytes = std::numeric_limits<std::size_t>::max())
+		: _max_bytes(max_bytes)
+	{ }
+
+	/**
+	 * The DFA of a rule set, the token id of a rule being its index.
+	 * @param rules the regular expressions of the rules
+	 * @return the DFA, null when there are no rules
+	 */
+	std::shared_ptr<const DFA> dfa(const std::vector<std::string>& rules);
+
+	/**
+	 * The DFA of a single rule, whose token id is 0.
+	 * @param rule the regular expression of the rule
+	 */
+	std::shared_ptr<const DFA> rule_dfa(const std::string& rule);
+
+	/**
+	 * The bytes of the cached automata.
+	 */
+	std::size_t memory_bytes() const;
+
+	/**
+	 * The number of cached automata, rules and unions.
+	 */
+	std::size_t size() const;
+
+private:
+	using dfa_ptr = std::shared_ptr<const DFA>;
+	using cached_type = std::pair<dfa_ptr, std::uint64_t>; /**< An automaton with its serial */
+
+	struct Entry
+	{
+		std::string key;
+		dfa_ptr dfa;
+		std::size_t bytes;
+		std::uint64_t serial; /**< Tells apart the automata cached under the same key over time */
+	};
+
+
+	/**
+	 * The DFA of a rule with its serial, which identifies the rule in the
+	 * keys of the unions.
+	 */
+	cached_type cached_rule(const std::string& rule);
+
+	/**
+	 * The union of the rules in [first, last), a range of at most size rules
+	 * starting at a multiple of size.
+	 */
+	dfa_ptr unite(const std::vector<cached_type>& rules,
+	              std::size_t first,
+	              std::size_t last,
+	              std::size_t size);
+
+	/**
+	 * Find a cached automaton and make it the most recently used.
+	 * @return the automaton, null if the key is not cached
+	 */
+	cached_type find(const std::string& key);
+
+	/**
+	 * Cache an automaton, dropping the least recently used ones beyond the
+	 * memory budget. The automaton already cached under the key is kept if
+	 * another thread built it meanwhile.
+	 * @return the cached automaton
+	 */
+	cached_type insert(const std::string& key, const dfa_ptr& dfa);
+
+
+	mutable std::mutex _mutex;
+	std::list<Entry> _entries; /**< The most recently used first */
+	std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+	std::size_t _bytes = 0;
+	std::size_t _max_bytes;
+	std::uint64_t _next_serial = 0;
+};
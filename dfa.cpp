@@ -3,168 +3,769 @@
 #include <vector>
 #include <utility>
 #include <memory>
-#include <queue>
 #include <numeric>
 #include <algorithm>
 #include <unordered_map>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
 
 #include "utility.h"
+#include "work_stealing_queue.h"
 
-DFA::DFA(const AugmentedRegexTree& tree)
+namespace
 {
+
+/**
+ * Split the bytes matched by the labels into disjoint ranges, such that each
+ * label matches either the whole range or none of it.
+ */
+std::vector<Regex::Symbol> byte_classes(const std::vector<Regex::Symbol>& labels)
+{
+	std::array<bool, 257> bound{};
+	std::array<bool, 256> covered{};
+	for (const auto& label : labels)
+	{
+		bound[label.first()] = bound[label.last() + 1] = true;
+		std::fill(covered.begin() + label.first(),
+		          covered.begin() + label.last() + 1,
+		          true);
+	}
+
+	std::vector<Regex::Symbol> result;
+	for (int first = 0; first < 256;)
+	{
+		int last = first;
+		while (last + 1 < 256 && !bound[last + 1]) ++last;
+
+		if (covered[first]) result.emplace_back(Regex::Symbol::byte_range(first, last));
+		first = last + 1;
+	}
+	return result;
+}
+
+/**
+ * The rules accepted by a set of positions.
+ * @param rules the bitset of the accepted rules, cleared beforehand
+ */
+void accepted_rules(const AugmentedRegexTree& tree,
+                    const AugmentedRegexTree::leaves_set_type& leaves,
+                    std::uint64_t* rules)
+{
+	for (auto leaf_pos : leaves)
+	{
+		if (tree.label(leaf_pos).is_end_marker())
+		{
+			auto rule_id = tree.leaf_regex_id(leaf_pos);
+			rules[rule_id / 64] |= std::uint64_t(1) << (rule_id % 64);
+		}
+	}
+}
+
+/**
+ * The token of a bitset of accepted rules, the rule that comes first wins
+ * when several rules are accepted.
+ * @return the id of the token, -1 if no rule is accepted
+ */
+int accepted_token(const std::uint64_t* rules, std::size_t words)
+{
+	for (std::size_t word = 0; word < words; ++word)
+	{
+		for (int bit = 0; rules[word] != 0 && bit < 64; ++bit)
+		{
+			if (rules[word] >> bit & 1) return word * 64 + bit;
+		}
+	}
+	return -1;
+}
+
+/**
+ * The positions following a set of positions through a symbol of the
+ * alphabet.
+ * @param new_leaves the result, its storage is reused
+ */
+void successor(const AugmentedRegexTree& tree,
+               const AugmentedRegexTree::leaves_set_type& leaves,
+               const Regex::Symbol& symbol,
+               AugmentedRegexTree::leaves_set_type& new_leaves)
+{
+	new_leaves.clear();
+	for (auto leaf_pos : leaves)
+	{
+		if (tree.label(leaf_pos).contains(symbol.first()))
+		{
+			auto followpos = tree.followpos(leaf_pos);
+			new_leaves.insert(new_leaves.end(), followpos.cbegin(), followpos.cend());
+		}
+	}
+
+	std::sort(new_leaves.begin(), new_leaves.end());
+	new_leaves.erase(std::unique(new_leaves.begin(), new_leaves.end()),
+	                 new_leaves.end());
+}
+
+/**
+ * The bytes held by a state, besides its set of positions and its
+ * transitions: its offset in the transitions.
+ */
+constexpr std::size_t state_bytes = sizeof(std::size_t);
+
+/**
+ * Mix values into a 64 bit FNV-1a hash, a value at a time.
+ */
+template<typename T>
+std::uint64_t hash_values(std::uint64_t hash, const T* values, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		hash = (hash ^ static_cast<std::uint64_t>(values[i])) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+/**
+ * Hash of a set of positions, independent of the iteration order.
+ */
+struct LeavesSetHash
+{
+	std::size_t operator()(const AugmentedRegexTree::leaves_set_type& leaves) const
+	{
+		std::size_t result = leaves.size();
+		for (auto leaf_pos : leaves)
+		{
+			result += std::hash<std::size_t>()(leaf_pos * 0x9E3779B97F4A7C15ull);
+		}
+		return result;
+	}
+};
+
+/**
+ * A hash table from sets of positions to state ids, that can be shared by
+ * several threads. Each shard of the table has its own lock.
+ */
+class StateTable
+{
+public:
 	using leaves_set_type = AugmentedRegexTree::leaves_set_type;
+	using entry_type = std::pair<int, const leaves_set_type*>;
 
-	auto create_state = [this]
+
+	/**
+	 * Find the state of a set of positions, or give it the next id.
+	 * @param leaves the set of positions, copied into the table only if the
+	 *               state is new
+	 * @return the id of the state with its set of positions, and true if
+	 *         the state is new
+	 */
+	std::pair<entry_type, bool> insert(const leaves_set_type& leaves)
 	{
-		states.emplace_back(std::make_unique<State>());
-		return states.back().get();
+		auto& shard = _shards[LeavesSetHash()(leaves) % _shards.size()];
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.ids.find(leaves);
+		if (it != shard.ids.end())
+		{
+			return std::make_pair(entry_type(it->second, &it->first), false);
+		}
+
+		it = shard.ids.emplace(leaves, _size++).first;
+		return std::make_pair(entry_type(it->second, &it->first), true);
+	}
+
+	/**
+	 * The number of states.
+	 */
+	std::size_t size() const
+	{ return _size; }
+
+private:
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<leaves_set_type, int, LeavesSetHash> ids;
 	};
 
-	set_alphabet(tree.labels());
 
-	std::vector<std::pair<State*, leaves_set_type>> dstates;
-	std::queue<std::size_t> q;
+	std::array<Shard, 64> _shards;
+	std::atomic<int> _size{0};
+};
+
+}
+
+constexpr int DFA::reject_state;
+
+DFA::DFA(const AugmentedRegexTree& tree,
+         unsigned int threads,
+         const Budget& budget)
+	: DFA(tree, std::vector<std::vector<int>>(), threads, budget)
+{ }
+
+DFA::DFA(const AugmentedRegexTree& tree,
+         const std::vector<std::vector<int>>& start_conditions,
+         unsigned int threads,
+         const Budget& budget)
+	: _accept_words((tree.rules_count() + 63) / 64)
+{
+	set_alphabet(byte_classes(tree.labels()));
+
+	std::vector<AugmentedRegexTree::leaves_set_type> starts;
+	for (const auto& rules : start_conditions)
+	{
+		starts.emplace_back(tree.firstpos_rules(rules));
+	}
+	if (starts.empty())
+	{
+		starts.emplace_back(tree.firstpos_root());
+	}
+
+	if (threads > 1)
+		build_parallel(tree, starts, threads, budget);
+	else
+		build_serial(tree, starts, budget);
+
+	close_transitions();
+	build_table();
+}
 
-	dstates.emplace_back(create_state(), tree.firstpos_root());
-	q.emplace(0);
+DFA::DFA(const DFA& first, const DFA& second)
+	: _accept_words(std::max(first._accept_words, second._accept_words))
+{
+	auto no_transition = [](const DFA& dfa, int byte)
+	{ return static_cast<std::size_t>(dfa._byte_class[byte]) + 1 == dfa._table_stride; };
 
-	while (!q.empty())
+	// The alphabet splits the bytes wherever the symbol of either DFA changes
+	std::vector<symbol_type> symbols;
+	for (int first_byte = 0; first_byte < 256;)
 	{
-		auto state = dstates[q.front()].first;
-		auto leaves = dstates[q.front()].second;
-		q.pop();
+		int last_byte = first_byte;
+		while (last_byte + 1 < 256 &&
+		       first._byte_class[last_byte + 1] == first._byte_class[first_byte] &&
+		       second._byte_class[last_byte + 1] == second._byte_class[first_byte])
+		{
+			++last_byte;
+		}
 
-		for (auto leaf_pos : leaves)
+		if (!no_transition(first, first_byte) || !no_transition(second, first_byte))
+			symbols.emplace_back(symbol_type::byte_range(first_byte, last_byte));
+		first_byte = last_byte + 1;
+	}
+	set_alphabet(symbols);
+
+	// A state of either DFA is -1 once it has no transition
+	auto key = [](int first_state, int second_state)
+	{
+		return static_cast<std::uint64_t>(static_cast<std::uint32_t>(first_state)) << 32 |
+		       static_cast<std::uint32_t>(second_state);
+	};
+
+	std::vector<std::pair<int, int>> pairs{{first.start_state(), second.start_state()}};
+	std::unordered_map<std::uint64_t, int> ids{{key(pairs[0].first, pairs[0].second), 0}};
+	add_state();
+
+	for (std::size_t i = 0; i < pairs.size(); ++i)
+	{
+		auto first_state = pairs[i].first;
+		auto second_state = pairs[i].second;
+
+		_accept_rules.resize((i + 1) * _accept_words);
+		auto rules = &_accept_rules[i * _accept_words];
+		if (first_state != -1)
 		{
-			// TODO: Create special symbol for end of augmented reged (#)
-			if (tree.label(leaf_pos).to_string() == "#")
+			for (std::size_t word = 0; word < first._accept_words; ++word)
+				rules[word] |= first._accept_rules[first_state * first._accept_words + word];
+		}
+		if (second_state != -1)
+		{
+			for (std::size_t word = 0; word < second._accept_words; ++word)
+				rules[word] |= second._accept_rules[second_state * second._accept_words + word];
+		}
+
+		auto token_id = accepted_token(rules, _accept_words);
+		if (token_id != -1)
+		{
+			accept_states.emplace_back(i, token_id);
+		}
+
+		for (std::size_t symbol = 0; symbol < symbols.size(); ++symbol)
+		{
+			auto byte = symbols[symbol].first();
+			auto first_next = first_state == -1 ? -1 : first.next(first_state, byte);
+			auto second_next = second_state == -1 ? -1 : second.next(second_state, byte);
+			if (first_next == -1 && second_next == -1) continue;
+
+			auto it = ids.find(key(first_next, second_next));
+			if (it == ids.end())
 			{
-				accept_states.emplace_back(state, tree.leaf_regex_id(leaf_pos));
-				break;
+				it = ids.emplace(key(first_next, second_next), pairs.size()).first;
+				pairs.emplace_back(first_next, second_next);
+				add_state();
 			}
+			add_transition(i, it->second, symbol);
 		}
+	}
+	close_transitions();
+
+	_start_states.emplace_back(0);
 
-		for (const auto& symbol : alphabet())
+	build_table();
+}
+
+void DFA::remap_tokens(const std::vector<int>& token_ids)
+{
+	auto words = (*std::max_element(token_ids.cbegin(), token_ids.cend()) + 64) / 64;
+
+	std::vector<std::uint64_t> accept_rules(states_count() * words);
+	for (int state_id = 0; state_id < states_count(); ++state_id)
+	{
+		for (std::size_t rule_id = 0; rule_id < token_ids.size(); ++rule_id)
 		{
-			leaves_set_type new_leaves;
-			for (auto leaf_pos : leaves)
+			if (rule_id / 64 < _accept_words && accepts(state_id, rule_id))
 			{
-				if (tree.label(leaf_pos) == symbol)
-				{
-					new_leaves = utility::union_sets(new_leaves,
-					                                 tree.followpos(leaf_pos));
-				}
+				auto new_id = token_ids[rule_id];
+				accept_rules[state_id * words + new_id / 64] |= std::uint64_t(1) << (new_id % 64);
 			}
+		}
+	}
+	_accept_rules.swap(accept_rules);
+	_accept_words = words;
+
+	// The winning rule may change with the order of the new ids
+	accept_states.clear();
+	for (int state_id = 0; state_id < states_count(); ++state_id)
+	{
+		auto token_id = accepted_token(&_accept_rules[state_id * _accept_words], _accept_words);
+		_token_ids[state_id] = token_id;
+		if (token_id != -1)
+		{
+			accept_states.emplace_back(state_id, token_id);
+		}
+	}
+
+	update_fingerprint();
+}
+
+void DFA::build_serial(const AugmentedRegexTree& tree,
+                       const std::vector<AugmentedRegexTree::leaves_set_type>& starts,
+                       const Budget& budget)
+{
+	using leaves_set_type = AugmentedRegexTree::leaves_set_type;
+
+	std::size_t bytes = 0;
+	auto create_state = [this, &bytes, &budget](const leaves_set_type& leaves)
+	{
+		bytes += state_bytes + utility::memory_bytes(leaves);
+		if (static_cast<std::size_t>(states_count()) == budget.max_states)
+			throw BudgetExceeded("number of DFA states exceeds the budget");
+		if (bytes > budget.max_bytes)
+			throw BudgetExceeded("memory used by the DFA exceeds the budget");
+
+		return add_state();
+	};
+	auto create_transition = [this, &bytes, &budget](int from, int to, int symbol)
+	{
+		bytes += sizeof(Transition);
+		if (bytes > budget.max_bytes)
+			throw BudgetExceeded("memory used by the DFA exceeds the budget");
+
+		add_transition(from, to, symbol);
+	};
+
+	// The sets of positions are owned by dstates_idx, whose nodes do not
+	// move, and dstates points to them in order of discovery, which is the
+	// order of the ids of their states
+	std::vector<const leaves_set_type*> dstates;
+	std::unordered_map<leaves_set_type, int, LeavesSetHash> dstates_idx;
+
+	// Start conditions with the same rules share their start state
+	for (const auto& start : starts)
+	{
+		auto it = dstates_idx.find(start);
+		if (it == dstates_idx.end())
+		{
+			it = dstates_idx.emplace(start, create_state(start)).first;
+			dstates.emplace_back(&it->first);
+		}
+		_start_states.emplace_back(it->second);
+	}
+
+	// The states are processed in order of discovery, breadth first
+	const auto& symbols = alphabet();
+	leaves_set_type new_leaves;
+	for (std::size_t i = 0; i < dstates.size(); ++i)
+	{
+		const auto& leaves = *dstates[i];
+
+		_accept_rules.resize((i + 1) * _accept_words);
+		accepted_rules(tree, leaves, &_accept_rules[i * _accept_words]);
+
+		auto token_id = accepted_token(&_accept_rules[i * _accept_words], _accept_words);
+		if (token_id != -1)
+		{
+			accept_states.emplace_back(i, token_id);
+		}
+
+		for (std::size_t symbol = 0; symbol < symbols.size(); ++symbol)
+		{
+			successor(tree, leaves, symbols[symbol], new_leaves);
 
 			if (new_leaves.empty()) continue;
 
-			auto it = std::find_if(dstates.cbegin(), dstates.cend(),
-			                       [new_leaves](auto elem)
-			                       { return new_leaves == elem.second; });
+			auto it = dstates_idx.find(new_leaves);
 
-			if (it == dstates.end())
+			if (it == dstates_idx.end())
 			{
-				auto new_state = create_state();
-				q.emplace(dstates.size());
-				dstates.emplace_back(new_state, new_leaves);
+				it = dstates_idx.emplace(new_leaves, create_state(new_leaves)).first;
+				dstates.emplace_back(&it->first);
+			}
+			create_transition(i, it->second, symbol);
+		}
+	}
+}
 
-				state->add_transition(new_state, symbol);
+void DFA::build_parallel(const AugmentedRegexTree& tree,
+                         const std::vector<AugmentedRegexTree::leaves_set_type>& starts,
+                         unsigned int threads,
+                         const Budget& budget)
+{
+	using leaves_set_type = AugmentedRegexTree::leaves_set_type;
+	using item_type = std::pair<int, const leaves_set_type*>;
+
+	// The accepted rules and the transitions, by alphabet index, of a
+	// state numbered in order of discovery
+	struct Result
+	{
+		std::vector<std::uint64_t> rules;
+		std::vector<std::pair<std::size_t, int>> transitions;
+	};
+
+	const auto& symbols = alphabet();
+
+	StateTable table;
+	WorkStealingQueue<item_type> queue(threads);
+	std::vector<std::vector<std::pair<int, Result>>> results(threads);
+
+	// Once the budget is exceeded, the workers drain the queue without
+	// adding states
+	std::atomic<std::size_t> bytes{0};
+	std::atomic<bool> exceeded{false};
+	auto count_state = [&](const leaves_set_type& leaves)
+	{
+		bytes += state_bytes + utility::memory_bytes(leaves);
+		if (table.size() > budget.max_states || bytes > budget.max_bytes)
+			exceeded = true;
+		return !exceeded;
+	};
+
+	std::vector<int> start_ids;
+	for (const auto& start : starts)
+	{
+		auto entry = table.insert(start);
+		if (entry.second && count_state(start)) queue.push(0, entry.first);
+
+		start_ids.emplace_back(entry.first.first);
+	}
+
+	auto work = [&](std::size_t worker)
+	{
+		item_type item;
+		leaves_set_type new_leaves;
+		while (queue.pop(worker, item))
+		{
+			if (exceeded)
+			{
+				queue.done();
+				continue;
+			}
+
+			Result result;
+			result.rules.resize(_accept_words);
+			accepted_rules(tree, *item.second, result.rules.data());
+
+			for (std::size_t i = 0; i < symbols.size(); ++i)
+			{
+				successor(tree, *item.second, symbols[i], new_leaves);
+
+				if (new_leaves.empty()) continue;
+
+				auto entry = table.insert(new_leaves);
+				if (entry.second && count_state(*entry.first.second))
+					queue.push(worker, entry.first);
+
+				result.transitions.emplace_back(i, entry.first.first);
 			}
-			else
+
+			bytes += result.transitions.size() * sizeof(Transition);
+
+			results[worker].emplace_back(item.first, std::move(result));
+			queue.done();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < threads; ++i)
+	{
+		workers.emplace_back(work, i);
+	}
+	work(0);
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	if (exceeded)
+		throw BudgetExceeded("DFA exceeds the budget of the subset construction");
+
+	std::vector<Result> discovered(table.size());
+	for (auto& worker_results : results)
+	{
+		for (auto& result : worker_results)
+		{
+			discovered[result.first] = std::move(result.second);
+		}
+	}
+
+	// Renumber the states in the order the serial construction creates
+	// them: breadth first from the start states, in alphabet order
+	std::vector<int> state_id(discovered.size(), -1);
+	std::vector<int> order;
+	for (auto id : start_ids)
+	{
+		if (state_id[id] == -1)
+		{
+			state_id[id] = order.size();
+			order.emplace_back(id);
+		}
+		_start_states.emplace_back(state_id[id]);
+	}
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		for (const auto& trans : discovered[order[i]].transitions)
+		{
+			if (state_id[trans.second] == -1)
 			{
-				state->add_transition(it->first, symbol);
+				state_id[trans.second] = order.size();
+				order.emplace_back(trans.second);
 			}
 		}
 	}
 
-	set_states_ids();
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		add_state();
+	}
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		const auto& result = discovered[order[i]];
+		for (const auto& trans : result.transitions)
+		{
+			add_transition(i, state_id[trans.second], trans.first);
+		}
+		_accept_rules.insert(_accept_rules.end(), result.rules.cbegin(), result.rules.cend());
+
+		auto token_id = accepted_token(result.rules.data(), _accept_words);
+		if (token_id != -1)
+		{
+			accept_states.emplace_back(i, token_id);
+		}
+	}
 }
 
 void DFA::minimize()
 {
 	// Initially: partition 0 is for non-accepting states
-	//            partition 1 is for acception states
-	int parts_count = 2;
-	std::vector<int> part(states.size());
+	//            a partition for the accepting states of each set of
+	//            rules, so matches() is kept along with the tokens
+	int parts_count = 1;
+	std::vector<int> part(states_count());
+	std::map<std::vector<std::uint64_t>, int> rules_part;
 	for (const auto& accept_state : accept_states)
 	{
-		part[accept_state.state->state_id()] = 1;
+		auto state_id = accept_state.state_id;
+		auto rules = _accept_rules.cbegin() + state_id * _accept_words;
+
+		auto it = rules_part.emplace(std::vector<std::uint64_t>(rules, rules + _accept_words),
+		                             parts_count);
+		if (it.second) ++parts_count;
+		part[state_id] = it.first->second;
 	}
 
+	std::vector<int> previous;
+	std::vector<int> first_next_part;
+	std::unordered_map<std::uint64_t, int> to;
+
 	int old_parts_count = -1;
 	while (old_parts_count != parts_count)
 	{
 		old_parts_count = parts_count;
 
-		// Iterate over partitions
-		for (int current_part = 0; current_part < parts_count; ++current_part)
+		// Split all the partitions at once through each symbol: the states
+		// going to the partition the first state of their partition goes
+		// to stay, the others move to a new partition for each pair of
+		// partitions
+		for (int symbol = 0; symbol < static_cast<int>(alphabet().size()); ++symbol)
 		{
-			// Iterate over symbols of the alphabet
-			for (auto symbol : alphabet())
+			previous = part;
+			first_next_part.assign(parts_count, -2);
+			to.clear();
+
+			for (int state_id = 0; state_id < states_count(); ++state_id)
 			{
-				// From next_part to new partition number
-				std::unordered_map<int, int> to;
+				auto current_part = previous[state_id];
+				auto next_state = symbol_transition(state_id, symbol);
+				auto next_part = next_state == -1 ? -1 : previous[next_state];
 
-				// Iterate over states inside one partition
-				for (std::size_t state_id = 0;
-					 state_id < states.size();
-					 ++state_id)
+				if (first_next_part[current_part] == -2)
 				{
-					if (part[state_id] != current_part) continue;
-
-					auto next_state = transition(state_id, symbol);
-					auto next_part = next_state == -1 ? -1 : part[next_state];
-
-					if (to.empty())
-					{
-						to[next_part] = current_part;
-					}
-					else if (to.find(next_part) == to.end())
-					{
-						to[next_part] = parts_count++; // new partition number
-					}
+					first_next_part[current_part] = next_part;
+				}
+				else if (first_next_part[current_part] != next_part)
+				{
+					auto key = static_cast<std::uint64_t>(current_part) << 32 |
+					           static_cast<std::uint32_t>(next_part);
+					auto it = to.emplace(key, parts_count);
+					if (it.second) ++parts_count; // new partition number
 
-					part[state_id] = to[next_part];
+					part[state_id] = it.first->second;
 				}
 			}
 		}
 	}
 
-	update_dfa(part, parts_count);
+	// Number the partitions in order of their first state, so the start
+	// states stay the first ones
+	std::vector<int> renumber(parts_count, -1);
+	int renumbered_count = 0;
+	for (auto& p : part)
+	{
+		if (renumber[p] == -1) renumber[p] = renumbered_count++;
+		p = renumber[p];
+	}
+
+	update_dfa(part, renumbered_count);
 }
 
 void DFA::update_dfa(const std::vector<int> & part, int parts_count)
 {
-	std::vector<std::unique_ptr<State>> new_states(parts_count);
+	// The states of a partition accept the same rules, and their
+	// transitions go to the same partitions, so the first state of each
+	// partition stands for it
+	std::vector<int> first_state(parts_count, -1);
+	for (int state_id = 0; state_id < states_count(); ++state_id)
+	{
+		if (first_state[part[state_id]] == -1) first_state[part[state_id]] = state_id;
+	}
 
-	for (std::size_t state_id = 0; state_id < states.size(); ++state_id)
+	std::vector<int> part_token(parts_count, -1);
+	for (const auto& accept_state : accept_states)
 	{
-		if (new_states[part[state_id]] == nullptr)
+		part_token[part[accept_state.state_id]] = accept_state.token_id;
+	}
+
+	std::vector<std::uint64_t> accept_rules(parts_count * _accept_words);
+	for (int i = 0; i < parts_count; ++i)
+	{
+		std::copy_n(_accept_rules.cbegin() + first_state[i] * _accept_words,
+		            _accept_words,
+		            accept_rules.begin() + i * _accept_words);
+	}
+	_accept_rules.swap(accept_rules);
+
+	auto offsets = std::move(_offsets);
+	auto transitions = std::move(_transitions);
+	clear_states();
+
+	for (int i = 0; i < parts_count; ++i)
+	{
+		add_state();
+		for (auto j = offsets[first_state[i]]; j < offsets[first_state[i] + 1]; ++j)
+		{
+			add_transition(i, part[transitions[j].state], transitions[j].symbol);
+		}
+		if (part_token[i] != -1)
 		{
-			new_states[part[state_id]] = std::move(states[state_id]);
+			accept_states.emplace_back(i, part_token[i]);
 		}
 	}
+	close_transitions();
+
+	for (auto& start_state : _start_states)
+	{
+		start_state = part[start_state];
+	}
 
-	for (auto& state : new_states)
+	build_table();
+}
+
+std::vector<int> DFA::matches(const std::string& input, int start_condition) const
+{
+	auto state = start_state(start_condition);
+	for (auto byte : input)
 	{
-		const auto& trans = state->transitions();
+		state = next(state, byte);
+		if (state == reject_state) return {};
+	}
 
-		for (std::size_t i = 0; i < trans.size(); ++i)
+	std::vector<int> result;
+	for (std::size_t word = 0; word < _accept_words; ++word)
+	{
+		auto rules = _accept_rules[state * _accept_words + word];
+		for (int bit = 0; rules != 0 && bit < 64; ++bit)
 		{
-			auto state_id = trans[i].state()->state_id();
+			if (rules >> bit & 1) result.emplace_back(word * 64 + bit);
+		}
+	}
+	return result;
+}
 
-			// If a state belongs to old states (not nullptr), update it
-			if (states[state_id] != nullptr)
-			{
-				state->update_transition(i,
-				                         new_states[part[state_id]].get(),
-				                         trans[i].symbol());
-			}
+std::size_t DFA::states_bytes() const
+{
+	return accept_states.capacity() * sizeof(accept_states[0]) +
+	       utility::memory_bytes(_alphabet) +
+	       utility::memory_bytes(_offsets) +
+	       utility::memory_bytes(_transitions) +
+	       utility::memory_bytes(_start_states) +
+	       utility::memory_bytes(_table) +
+	       utility::memory_bytes(_token_ids) +
+	       utility::memory_bytes(_accept_rules);
+}
+
+void DFA::build_table()
+{
+	const auto& symbols = alphabet();
+
+	// The bytes of no symbol go to the last column, without transitions
+	_table_stride = symbols.size() + 1;
+	for (int byte = 0; byte < 256; ++byte)
+	{
+		_byte_class[byte] = _byte_symbols[byte] == -1 ? symbols.size() : _byte_symbols[byte];
+	}
+
+	// The columns of the table are the symbols of the alphabet
+	_table.assign(states_count() * _table_stride, -1);
+	for (int state_id = 0; state_id < states_count(); ++state_id)
+	{
+		for (auto trans = transitions_begin(state_id); trans != transitions_end(state_id); ++trans)
+		{
+			_table[state_id * _table_stride + trans->symbol] = trans->state;
 		}
 	}
 
-	states.assign(std::make_move_iterator(new_states.begin()),
-	              std::make_move_iterator(new_states.end()));
+	_token_ids.assign(states_count(), -1);
+	for (const auto& accept_state : accept_states)
+	{
+		_token_ids[accept_state.state_id] = accept_state.token_id;
+	}
 
-	set_states_ids();
+	update_fingerprint();
+}
+
+void DFA::update_fingerprint()
+{
+	std::uint64_t hash = 0xCBF29CE484222325ull;
+	hash = hash_values(hash, _byte_class.data(), _byte_class.size());
+	hash = hash_values(hash, _start_states.data(), _start_states.size());
+	hash = hash_values(hash, _table.data(), _table.size());
+	hash = hash_values(hash, _token_ids.data(), _token_ids.size());
+	_fingerprint = hash_values(hash, _accept_rules.data(), _accept_rules.size());
 }
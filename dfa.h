@@ -1,6 +1,11 @@
 #pragma once
 
 #include <vector>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <cstdint>
 
 #include "finite_automaton.h"
 #include "regex_tree.h"
@@ -11,22 +16,203 @@
 class DFA : public FiniteAutomaton
 {
 public:
+	/**
+	 * Limits on the subset construction. The bytes count the states with
+	 * their sets of positions and transitions, as held during construction.
+	 */
+	struct Budget
+	{
+		Budget(std::size_t states = std::numeric_limits<std::size_t>::max(),
+		       std::size_t bytes = std::numeric_limits<std::size_t>::max())
+			: max_states(states), max_bytes(bytes)
+		{ }
+
+		std::size_t max_states; /**< The maximum number of states */
+		std::size_t max_bytes; /**< The maximum number of bytes */
+	};
+
+	/**
+	 * Thrown when the subset construction exceeds its budget. The rules can
+	 * still be scanned with a PositionAutomaton.
+	 */
+	class BudgetExceeded : public std::length_error
+	{
+	public:
+		using std::length_error::length_error;
+	};
+
+	/**
+	 * The state reached once no rule can match anymore. Every other state
+	 * reaches an accepting state, as every position of a tree reaches its
+	 * end marker, but the start state of a start condition without rules.
+	 * So a scan stops as soon as a lexeme is doomed.
+	 */
+	static constexpr int reject_state = -1;
+
+
 	/**
 	 * Convert an augmented regular expression tree directly to DFA
 	 * @param tree augmented regular expression tree
+	 * @param threads the number of threads running the subset construction,
+	 *                the result does not depend on it
+	 * @param budget the limits on the construction
+	 * @throw BudgetExceeded when the construction exceeds the budget
+	 */
+	explicit DFA(const AugmentedRegexTree& tree,
+	             unsigned int threads = 1,
+	             const Budget& budget = Budget());
+
+	/**
+	 * Convert an augmented regular expression tree to a DFA with a start
+	 * state for each start condition. The states reachable from several
+	 * start conditions are shared.
+	 * @param tree augmented regular expression tree
+	 * @param start_conditions the ids of the rules active in each start condition
+	 * @param threads the number of threads running the subset construction
+	 * @param budget the limits on the construction
+	 * @throw BudgetExceeded when the construction exceeds the budget
+	 */
+	DFA(const AugmentedRegexTree& tree,
+	    const std::vector<std::vector<int>>& start_conditions,
+	    unsigned int threads = 1,
+	    const Budget& budget = Budget());
+
+	/**
+	 * Make the union of two DFAs: the states are the pairs of their states
+	 * reachable together, so neither the trees nor the sets of positions of
+	 * their rules are needed. The rule of lowest id wins, as in a DFA
+	 * built from the union of the rules.
+	 * @param first the first DFA, its first start condition is used
+	 * @param second the second DFA, its first start condition is used
+	 */
+	DFA(const DFA& first, const DFA& second);
+
+	/**
+	 * Rename the tokens of the DFA.
+	 * @param token_ids the new id of each token
 	 */
-	explicit DFA(const AugmentedRegexTree& tree);
+	void remap_tokens(const std::vector<int>& token_ids);
 
 	/**
 	 * Create minimal DFA using Hopcroft’s Algorithm.
 	 */
 	void minimize();
 
+	/**
+	 * The id of the start state of a start condition.
+	 * @param start_condition the index of the start condition
+	 */
+	int start_state(int start_condition = 0) const
+	{ return _start_states[start_condition]; }
+
+	/**
+	 * The number of start conditions.
+	 */
+	int start_conditions_count() const
+	{ return _start_states.size(); }
+
+	/**
+	 * Transition from a state to another through a byte of the input.
+	 * @param state_id the id of the state to look from
+	 * @param byte the byte of the input
+	 * @return the id of the next state and reject_state if there is no
+	 *         transition
+	 */
+	int next(int state_id, unsigned char byte) const
+	{
+		return _table[state_id * _table_stride + _byte_class[byte]];
+	}
+
+	/**
+	 * The token accepted by a state.
+	 * @param state_id the id of the state
+	 * @return the id of the accepted token and -1 if the state is not accepting
+	 */
+	int token_id(int state_id) const
+	{ return _token_ids[state_id]; }
+
+	/**
+	 * Check if a state accepts a rule, whether or not the rule wins.
+	 * @param state_id the id of the state
+	 * @param rule_id the id of the rule
+	 */
+	bool accepts(int state_id, int rule_id) const
+	{
+		return _accept_rules[state_id * _accept_words + rule_id / 64] >> (rule_id % 64) & 1;
+	}
+
+	/**
+	 * All the rules matching a whole input, found in one pass.
+	 * @param input the input
+	 * @param start_condition the index of the start condition
+	 * @return the ids of the matching rules in increasing order
+	 */
+	std::vector<int> matches(const std::string& input, int start_condition = 0) const;
+
+	/**
+	 * Approximate heap bytes used by the states, their transitions and the
+	 * transition table.
+	 */
+	std::size_t states_bytes() const;
+
+	/**
+	 * A hash of the transition table, the start states and the accepted
+	 * rules, which tells whether two DFAs scan the same way. It is kept
+	 * along with the table, so it costs nothing to read.
+	 */
+	std::uint64_t fingerprint() const
+	{ return _fingerprint; }
+
 private:
+	/**
+	 * Subset construction processing the states one at a time.
+	 */
+	void build_serial(const AugmentedRegexTree& tree,
+	                  const std::vector<AugmentedRegexTree::leaves_set_type>& starts,
+	                  const Budget& budget);
+
+	/**
+	 * Subset construction with the states shared by several threads through
+	 * a work stealing queue. The states are renumbered at the end, so the
+	 * result is the same as build_serial().
+	 */
+	void build_parallel(const AugmentedRegexTree& tree,
+	                    const std::vector<AugmentedRegexTree::leaves_set_type>& starts,
+	                    unsigned int threads,
+	                    const Budget& budget);
+
 	/**
 	 * Update the dfa after applying minimize function.
 	 * @param part partition's id for each state
 	 * @param parts_count the number of partitions resulting from minimization algorithm
 	 */
 	void update_dfa(const std::vector<int> & part, int parts_count);
+
+	/**
+	 * Build the byte indexed transition table used for scanning.
+	 */
+	void build_table();
+
+	/**
+	 * Hash what the scanning depends on into _fingerprint.
+	 */
+	void update_fingerprint();
+
+
+	std::vector<int> _start_states; /**< The start state of each start condition */
+	/**
+	 * Index of the alphabet symbol matching each byte, the bytes out of the
+	 * alphabet have an extra column without transitions
+	 */
+	std::array<int, 256> _byte_class;
+	std::vector<int> _table; /**< Next state for each state and alphabet symbol */
+	std::size_t _table_stride; /**< The number of columns of the table */
+	std::vector<int> _token_ids; /**< Accepted token for each state */
+	/**
+	 * Bitset of the rules accepted by each state, _accept_words words
+	 * per state
+	 */
+	std::vector<std::uint64_t> _accept_rules;
+	std::size_t _accept_words;
+	std::uint64_t _fingerprint; /**< See fingerprint() */
 };
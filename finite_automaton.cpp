@@ -1,36 +1,47 @@
 #include "finite_automaton.h"
 
 #include <algorithm>
-#include <unordered_set>
 #include <iostream>
+#include <string>
 
-const std::vector<FiniteAutomaton::symbol_type> & FiniteAutomaton::alphabet() const
+int FiniteAutomaton::transition(int state_id, const symbol_type & symbol) const
 {
-	if (_alphabet.empty())
-	{
-		std::unordered_set<symbol_type> symbolset;
-		for (std::size_t i = 0; i < states.size(); ++i)
-		{
-			for (const auto& p : states[i]->transitions())
-			{
-				if (!p.symbol().is_epsilon()) symbolset.insert(p.symbol());
-			}
-		}
-		_alphabet.assign(symbolset.begin(), symbolset.end());
-	}
-	return _alphabet;
+	if (!symbol.is_char() && !symbol.is_range()) return -1;
+
+	// The symbols are disjoint, so the first byte tells which one it can be
+	auto index = _byte_symbols[symbol.first()];
+
+	return index == -1 || _alphabet[index] != symbol ?
+		-1 :
+		symbol_transition(state_id, index);
 }
 
-int FiniteAutomaton::transition(int state_id, const symbol_type & symbol) const
+int FiniteAutomaton::symbol_transition(int state_id, int symbol) const
 {
-	auto it = std::find_if(states[state_id]->transitions().begin(),
-	                       states[state_id]->transitions().end(),
-	                       [symbol](auto trans)
-	                       { return trans.symbol() == symbol; });
+	auto end = transitions_end(state_id);
+	auto it = std::lower_bound(transitions_begin(state_id), end, symbol,
+	                           [](const Transition& trans, int value)
+	                           { return trans.symbol < value; });
 
-	return it == states[state_id]->transitions().end() ?
+	return it == end || it->symbol != symbol ?
 		-1 :
-		it->state()->state_id();
+		it->state;
+}
+
+void FiniteAutomaton::set_alphabet(const std::vector<symbol_type>& alphabet)
+{
+	_alphabet.assign(alphabet.cbegin(), alphabet.cend());
+
+	_byte_symbols.fill(-1);
+	for (std::size_t i = 0; i < _alphabet.size(); ++i)
+	{
+		if (!_alphabet[i].is_char() && !_alphabet[i].is_range()) continue;
+
+		for (int byte = _alphabet[i].first(); byte <= _alphabet[i].last(); ++byte)
+		{
+			_byte_symbols[byte] = i;
+		}
+	}
 }
 
 void FiniteAutomaton::print() const
@@ -38,27 +49,25 @@ void FiniteAutomaton::print() const
 	std::cout << "Accept states: ";
 	for (auto accept_state : accept_states)
 	{
-		std::cout << accept_state.state->state_id() << ' ';
+		std::cout << accept_state.state_id << ' ';
 	}
 	std::cout << '\n';
-	for (std::size_t i = 0; i < states.size(); ++i)
+
+	std::vector<std::string> labels;
+	for (const auto& symbol : _alphabet)
 	{
-		auto p = states[i].get();
-		for (const auto& trans : p->transitions())
+		labels.emplace_back(symbol.is_epsilon() ? "epsilon" : symbol.to_string());
+	}
+
+	for (int state_id = 0; state_id < _states_count; ++state_id)
+	{
+		for (auto trans = transitions_begin(state_id); trans != transitions_end(state_id); ++trans)
 		{
-			std::cout << "from state #" << p->state_id()
-			          << " through: " << (trans.symbol().is_epsilon() ? "epsilon" : trans.symbol().to_string())
-			          << " to state #" << trans.state()->state_id()
+			std::cout << "from state #" << state_id
+			          << " through: " << labels[trans->symbol]
+			          << " to state #" << trans->state
 			          << '\n';
 		}
 		std::cout << "--------------\n\n";
 	}
 }
-
-void FiniteAutomaton::set_states_ids()
-{
-	for (std::size_t i = 0; i < states.size(); ++i)
-	{
-		states[i]->_state_id = i;
-	}
-}
@@ -1,136 +1,178 @@
 #pragma once
 
 #include <vector>
+#include <array>
 #include <utility>
-#include <memory>
+#include <cstddef>
 
 #include "regex.h"
 
 /**
  * A class for finite automaton.
+ *
+ * The states are numbered from 0 and their transitions are stored in
+ * compressed sparse rows: the transitions of all the states lie in one
+ * array, those of a state being contiguous and sorted by symbol, and an
+ * array of offsets gives where the transitions of each state begin.
  */
 class FiniteAutomaton
 {
 public:
 	using symbol_type = Regex::Symbol;
-	using eps_closure_type = std::vector<bool>;
-
-protected:
-	/**
-	 * Give unique id to each state of the FiniteAutomaton states.
-	 */
-	void set_states_ids();
-
-	void set_alphabet(const std::vector<symbol_type>& alphabet)
-	{ _alphabet.assign(alphabet.cbegin(), alphabet.cend()); }
 
 	/**
-	 * A class that represents a state of a FiniteAutomaton.
+	 * A transition from a state, through a symbol of the alphabet.
 	 */
-	class State
+	struct Transition
 	{
-	private:
-		struct Transition
-		{
-			Transition(const State* state, const symbol_type & symbol)
-				: _state(state), _symbol(symbol)
-			{ }
-
-			const State* state() const
-			{ return _state; }
-
-			symbol_type symbol() const
-			{ return _symbol; }
-
-		private:
-			const State* _state;
-			symbol_type _symbol;
-		};
-
-	public:
-		/**
-		 * Returns the id of the state.
-		 */
-		int state_id() const
-		{ return _state_id; }
-
-		/**
-		 * Returns a const reference to transitions vector.
-		 */
-		const std::vector<Transition> & transitions() const
-		{ return _transitions; }
-
-		/**
-		 * Adds a transition from the state.
-		 * @param state the state to add a transition to
-		 * @param symbol the symbol lable of the transition
-		 */
-		void add_transition(State* state, const symbol_type & symbol = symbol_type())
-		{ _transitions.emplace_back(state, symbol); }
-
-		/**
-		 * Updates the transition at a given index.
-		 * @param idx the given index
-		 * @param state the new state
-		 * @param symbol the new symbol
-		 */
-		void update_transition(std::size_t idx, State* state, const symbol_type & symbol)
-		{ _transitions[idx] = Transition(state, symbol); }
-
-		friend void FiniteAutomaton::set_states_ids();
-
-	private:
-		int _state_id; /**< unique id for each states */
-		std::vector<Transition> _transitions; /**< all transitions from a state */
+		int symbol; /**< The index of the symbol in the alphabet */
+		int state; /**< The id of the state the transition goes to */
 	};
 
-public:
+	FiniteAutomaton()
+	{ _byte_symbols.fill(-1); }
+
 	/**
 	 * Check if the FiniteAutomaton is empty.
 	 * @return true when the FiniteAutomaton is empty, and false otherwise.
 	 */
 	bool empty() const
-	{ return states.empty(); }
+	{ return _states_count == 0; }
 
 	/**
 	 * The number of states in the automaton.
 	 * @return the number of states
 	 */
 	int states_count() const
-	{ return states.size(); }
+	{ return _states_count; }
 
 	/**
 	 * Getter for the alphabet of the FiniteAutomaton.
 	 * @return the alphabet of the FiniteAutomaton
 	 */
-	const std::vector<symbol_type> & alphabet() const;
+	const std::vector<symbol_type> & alphabet() const
+	{ return _alphabet; }
+
+	/**
+	 * The first transition of a state, its transitions are sorted by symbol
+	 * and end at transitions_begin(state_id + 1).
+	 * @param state_id the id of the state
+	 */
+	const Transition* transitions_begin(int state_id) const
+	{ return _transitions.data() + _offsets[state_id]; }
 
 	/**
-	 * Transition from a state to another through a symbol
+	 * The end of the transitions of a state.
+	 * @param state_id the id of the state
+	 */
+	const Transition* transitions_end(int state_id) const
+	{ return _transitions.data() + _offsets[state_id + 1]; }
+
+	/**
+	 * Transition from a state to another through a symbol, found from the
+	 * first byte of the symbol without searching the alphabet.
 	 * @param state_id the id of the state to look from
 	 * @param symbol the symbol of the transition
 	 * @return the id of the founded state and -1 if no state is found
 	 */
 	int transition(int state_id, const symbol_type & symbol) const;
 
+	/**
+	 * Transition from a state to another through a symbol of the alphabet,
+	 * found by binary search among the transitions of the state.
+	 * @param state_id the id of the state to look from
+	 * @param symbol the index of the symbol in the alphabet
+	 * @return the id of the founded state and -1 if no state is found
+	 */
+	int symbol_transition(int state_id, int symbol) const;
+
 	/**
 	 * Print the FiniteAutomaton.
 	 */
 	void print() const;
 
 protected:
+	/**
+	 * Set the symbols of the transitions.
+	 * @param alphabet disjoint byte ranges
+	 */
+	void set_alphabet(const std::vector<symbol_type>& alphabet);
+
+	/**
+	 * Add a state without transitions.
+	 * @return the id of the state
+	 */
+	int add_state()
+	{ return _states_count++; }
+
+	/**
+	 * Add a transition from a state. The transitions are added in order of
+	 * their states, and in order of their symbols for a state, so they are
+	 * appended to the rows.
+	 * @param from the id of the state to add a transition from
+	 * @param to the id of the state to add a transition to
+	 * @param symbol the index of the symbol in the alphabet
+	 */
+	void add_transition(int from, int to, int symbol)
+	{
+		close_rows(from);
+		_transitions.push_back(Transition{symbol, to});
+	}
+
+	/**
+	 * Close the rows of the states without further transitions, to be
+	 * called once all the transitions are added.
+	 */
+	void close_transitions()
+	{ close_rows(_states_count); }
+
+	/**
+	 * Remove all the states and their transitions, keeping the alphabet.
+	 */
+	void clear_states()
+	{
+		_states_count = 0;
+		_offsets.assign(1, 0);
+		_transitions.clear();
+		accept_states.clear();
+	}
+
 	struct AcceptState
 	{
-		AcceptState(State* state, int token_id)
-			: state(state), token_id(token_id)
+		AcceptState(int state, int token)
+			: state_id(state), token_id(token)
 		{ }
 
-		State* state;
+		int state_id;
 		int token_id;
 	};
 
 
-	std::vector<std::unique_ptr<State>> states; /**< The states of the FiniteAutomaton */
 	std::vector<AcceptState> accept_states; /**< The set of accepting states */
-	mutable std::vector<symbol_type> _alphabet; /**< Cached alphabet */
+	std::vector<symbol_type> _alphabet; /**< The symbols of the transitions */
+	/**
+	 * The index in the alphabet of the symbol matching each byte, -1 for
+	 * the bytes of no symbol
+	 */
+	std::array<int, 256> _byte_symbols;
+	int _states_count = 0; /**< The number of states */
+	/**
+	 * Where the transitions of each state begin in _transitions, with the
+	 * end of the last state at the back
+	 */
+	std::vector<std::size_t> _offsets{0};
+	std::vector<Transition> _transitions; /**< The transitions of all the states */
+
+private:
+	/**
+	 * End the rows of the states before a given one, that one receiving the
+	 * transitions appended next.
+	 */
+	void close_rows(int state_id)
+	{
+		while (_offsets.size() <= static_cast<std::size_t>(state_id))
+		{
+			_offsets.push_back(_transitions.size());
+		}
+	}
 };
@@ -0,0 +1,38 @@
+#include "line_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+TextPosition LineIndex::position(std::size_t offset) const
+{
+	build();
+
+	// The newlines before the offset
+	auto line = std::lower_bound(_newlines.cbegin(), _newlines.cend(), offset) - _newlines.cbegin();
+	auto line_start = line == 0 ? 0 : _newlines[line - 1] + 1;
+
+	return TextPosition{static_cast<std::size_t>(line) + 1, offset - line_start + 1};
+}
+
+std::size_t LineIndex::lines_count() const
+{
+	build();
+	return _newlines.size() + 1;
+}
+
+void LineIndex::build() const
+{
+	std::call_once(_built, [this]
+	{
+		// memchr is vectorized by the C library, the newlines are found
+		// many bytes at a time
+		auto data = _input.data();
+		auto end = data + _input.length();
+		for (auto p = data;
+		     (p = static_cast<const char*>(std::memchr(p, '\n', end - p))) != nullptr;
+		     ++p)
+		{
+			_newlines.emplace_back(p - data);
+		}
+	});
+}
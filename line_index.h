@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+
+/**
+ * A line and a column in an input, both starting at 1. The column counts
+ * bytes.
+ */
+struct TextPosition
+{
+	std::size_t line;
+	std::size_t column;
+};
+
+/**
+ * A class for finding the line and column of byte offsets, such as the
+ * offsets of the tokens of a Scanner. The offsets of the newlines are only
+ * looked for on the first query, so scanning costs nothing more when no
+ * position is asked for.
+ */
+class LineIndex
+{
+public:
+	/**
+	 * @param input the input, it must outlive the index and not change
+	 */
+	explicit LineIndex(const std::string& input)
+		: _input(input)
+	{ }
+
+	/**
+	 * The line and column of a byte offset, it can be called from several
+	 * threads.
+	 * @param offset an offset of the input, or its length
+	 */
+	TextPosition position(std::size_t offset) const;
+
+	/**
+	 * The number of lines of the input.
+	 */
+	std::size_t lines_count() const;
+
+private:
+	/**
+	 * Find the offsets of the newlines, once.
+	 */
+	void build() const;
+
+
+	const std::string& _input;
+	mutable std::once_flag _built;
+	mutable std::vector<std::size_t> _newlines; /**< The offsets of the newlines */
+};
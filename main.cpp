@@ -1,16 +1,356 @@
 #include "regex.h"
 #include "regex_tree.h"
 #include "dfa.h"
+#include "scanner.h"
+#include "work_stealing_queue.h"
 
 #include <string>
-
+#include <vector>
+#include <fstream>
+#include <sstream>
 #include <iostream>
-using std::cout;
-using std::endl;
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <map>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+void usage()
+{
+	std::cerr << "usage: lexer [-j threads] [-o output_dir] rules_file path...\n"
+	          << "  rules_file  one regular expression per line, the token id of a rule\n"
+	          << "              is the index of its line among the non empty ones\n"
+	          << "  path        a file, or a directory lexed recursively\n"
+	          << "  -j          the number of threads, at most 4 per core\n"
+	          << "  -o          write a token stream per file, to output_dir/path.tok,\n"
+	          << "              where path is made relative without leaving output_dir\n";
+}
+
+/**
+ * The union of the rules of a rule file, as accepted by AugmentedRegex.
+ * Each rule is parsed on its own first, so that a rule cannot reach into
+ * the others once they are joined.
+ */
+std::string read_rules(const std::string& file)
+{
+	std::ifstream in(file);
+	if (!in) throw std::runtime_error("cannot read the file");
+
+	std::string rules;
+	std::size_t line_number = 0;
+	for (std::string line; std::getline(in, line);)
+	{
+		++line_number;
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty()) continue;
+
+		auto where = file + ':' + std::to_string(line_number) + ": ";
+		try
+		{
+			Regex regex(line);
+			for (const auto& symbol : regex.symbols())
+			{
+				if (symbol.is_end_marker())
+					throw std::invalid_argument("# ends a rule, use \\# to match it");
+			}
+
+			// Reports the unbalanced parentheses and the empty operands
+			RegexTree tree(regex);
+		}
+		catch (const std::exception& e)
+		{
+			throw std::runtime_error(where + e.what());
+		}
+
+		rules += (rules.empty() ? "" : ")#|(") + line;
+	}
+	if (rules.empty()) throw std::runtime_error(file + " has no rules");
+
+	return rules;
+}
+
+/**
+ * Add the regular files of a path, recursing into directories.
+ */
+void list_files(const std::string& path, std::vector<std::string>& files)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+	{
+		std::cerr << "cannot access " << path << '\n';
+		return;
+	}
+
+	if (S_ISREG(info.st_mode))
+	{
+		files.emplace_back(path);
+		return;
+	}
+	if (!S_ISDIR(info.st_mode)) return;
+
+	auto dir = opendir(path.c_str());
+	if (dir == nullptr) return;
+
+	while (auto entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..") continue;
+
+		list_files(path + '/' + name, files);
+	}
+	closedir(dir);
+}
+
+/**
+ * Create a directory with its parents.
+ */
+void make_directories(const std::string& path)
+{
+	for (auto slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+	{
+		auto dir = path.substr(0, slash);
+		if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+			throw std::runtime_error("cannot create " + dir);
+		if (slash == std::string::npos) break;
+	}
+}
+
+/**
+ * The path of the token stream of a file under the output directory. The
+ * path of the file is made relative and its `..` are resolved without
+ * going above the output directory, so that ../a and /a are written to
+ * output_dir/a.tok. Files whose paths collide this way are rejected before
+ * any is lexed.
+ */
+std::string output_path(const std::string& output_dir, const std::string& file)
+{
+	std::vector<std::string> components;
+	std::istringstream in(file);
+	for (std::string component; std::getline(in, component, '/');)
+	{
+		if (component.empty() || component == ".") continue;
+
+		if (component != "..") components.emplace_back(component);
+		else if (!components.empty()) components.pop_back();
+	}
+
+	auto path = output_dir;
+	for (const auto& component : components)
+	{
+		path += '/' + component;
+	}
+	return path + ".tok";
+}
 
-int main()
+/**
+ * Parse the thread count of -j, capped at a few threads per core.
+ * @throw std::invalid_argument if it is not a positive number
+ */
+unsigned int parse_threads(const std::string& arg)
 {
-	AugmentedRegexTree x(AugmentedRegex("(ab)#|(c)#"));
-	DFA dfa(x);
-	dfa.print();
+	if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos)
+		throw std::invalid_argument("invalid thread count: " + arg);
+
+	const unsigned long max_threads = 4 * std::max(std::thread::hardware_concurrency(), 1u);
+	unsigned long threads = max_threads;
+	try
+	{
+		threads = std::stoul(arg);
+	}
+	catch (const std::out_of_range&)
+	{
+	}
+
+	if (threads == 0)
+		throw std::invalid_argument("invalid thread count: " + arg);
+	return std::min(threads, max_threads);
+}
+
+/**
+ * Append an unsigned LEB128 number.
+ */
+void write_varint(std::string& out, std::size_t value)
+{
+	while (value >= 0x80)
+	{
+		out += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int threads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::string output_dir;
+	std::vector<std::string> args;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if ((arg == "-j" || arg == "-o") && i + 1 < argc)
+		{
+			if (arg != "-j")
+			{
+				output_dir = argv[++i];
+				continue;
+			}
+
+			try
+			{
+				threads = parse_threads(argv[++i]);
+			}
+			catch (const std::invalid_argument& e)
+			{
+				std::cerr << "error: " << e.what() << '\n';
+				usage();
+				return 2;
+			}
+		}
+		else
+		{
+			args.emplace_back(arg);
+		}
+	}
+	if (args.size() < 2)
+	{
+		usage();
+		return 2;
+	}
+
+	try
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// The automaton is built once and only read by the workers
+		AugmentedRegexTree tree(AugmentedRegex(read_rules(args[0])));
+		DFA dfa(tree, threads);
+		dfa.minimize();
+
+		auto built = std::chrono::steady_clock::now();
+		std::cerr << dfa.states_count() << " states built in "
+		          << std::chrono::duration<double>(built - start).count() << " s\n";
+
+		std::vector<std::string> files;
+		for (std::size_t i = 1; i < args.size(); ++i)
+		{
+			list_files(args[i], files);
+		}
+
+		// Two files written to the same token stream would race
+		std::vector<std::string> output_paths;
+		if (!output_dir.empty())
+		{
+			std::map<std::string, std::size_t> owners;
+			for (std::size_t i = 0; i < files.size(); ++i)
+			{
+				output_paths.emplace_back(output_path(output_dir, files[i]));
+				auto owner = owners.emplace(output_paths.back(), i);
+				if (!owner.second)
+				{
+					throw std::runtime_error(files[owner.first->second] + " and " + files[i] +
+					                         " are both written to " + output_paths.back());
+				}
+			}
+		}
+
+		WorkStealingQueue<std::size_t> queue(threads);
+		for (std::size_t i = 0; i < files.size(); ++i)
+		{
+			queue.push(i % threads, i);
+		}
+
+		std::atomic<std::size_t> total_bytes{0};
+		std::atomic<std::size_t> total_tokens{0};
+		std::atomic<std::size_t> failures{0};
+
+		auto work = [&](std::size_t worker)
+		{
+			Scanner scanner(dfa);
+			std::string content;
+			std::string stream;
+
+			std::size_t index;
+			while (queue.pop(worker, index))
+			{
+				const auto& file = files[index];
+
+				// A file that fails does not stop the others
+				try
+				{
+					std::ifstream in(file, std::ios::binary);
+					if (!in) throw std::runtime_error("cannot read the file");
+
+					std::ostringstream buffer;
+					buffer << in.rdbuf();
+					content = buffer.str();
+
+					// The stream: "TOK1", then the id + 1 and the length of
+					// each token, the offsets follow from the lengths
+					stream.assign("TOK1");
+					std::size_t tokens = 0;
+					scanner.scan(content, [&stream, &tokens](const Token& token)
+					{
+						write_varint(stream, token.token_id + 1);
+						write_varint(stream, token.length);
+						++tokens;
+					});
+
+					if (!output_dir.empty())
+					{
+						const auto& path = output_paths[index];
+						make_directories(path.substr(0, path.rfind('/')));
+						std::ofstream out(path, std::ios::binary);
+						out.write(stream.data(), stream.size());
+						if (!out) throw std::runtime_error("cannot write " + path);
+					}
+
+					total_bytes += content.size();
+					total_tokens += tokens;
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << file << ": " << e.what() << '\n';
+					++failures;
+				}
+				queue.done();
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 1; i < threads; ++i)
+		{
+			workers.emplace_back(work, i);
+		}
+		work(0);
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - built).count();
+		std::cout << files.size() << " files, "
+		          << total_bytes << " bytes, "
+		          << total_tokens << " tokens in " << seconds << " s with "
+		          << threads << " threads: "
+		          << total_bytes / seconds / 1e6 << " MB/s, "
+		          << total_tokens / seconds << " tokens/s\n";
+
+		return failures == 0 ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << '\n';
+		return 1;
+	}
 }
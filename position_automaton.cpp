@@ -0,0 +1,124 @@
+#include "position_automaton.h"
+
+#include <algorithm>
+
+#include "utility.h"
+
+PositionAutomaton::PositionAutomaton(const AugmentedRegexTree& tree)
+	: PositionAutomaton(tree, std::vector<std::vector<int>>())
+{ }
+
+PositionAutomaton::PositionAutomaton(
+	const AugmentedRegexTree& tree,
+	const std::vector<std::vector<int>>& start_conditions)
+{
+	auto add_start = [this](const AugmentedRegexTree::leaves_set_type& start)
+	{
+		_starts.emplace_back(start);
+	};
+
+	for (const auto& rules : start_conditions)
+	{
+		add_start(tree.firstpos_rules(rules));
+	}
+	if (_starts.empty())
+	{
+		add_start(tree.firstpos_root());
+	}
+
+	_ranges.reserve(tree.positions_count());
+	_token_ids.reserve(tree.positions_count());
+	_followpos_begin.reserve(tree.positions_count() + 1);
+	for (leaf_pos_type i = 0; i < tree.positions_count(); ++i)
+	{
+		const auto& label = tree.label(i);
+		if (label.is_end_marker())
+		{
+			_ranges.emplace_back(1, 0);
+			_token_ids.emplace_back(tree.leaf_regex_id(i));
+		}
+		else
+		{
+			_ranges.emplace_back(label.first(), label.last());
+			_token_ids.emplace_back(-1);
+		}
+
+		_followpos_begin.emplace_back(_followpos.size());
+		auto followpos = tree.followpos(i);
+		_followpos.insert(_followpos.end(), followpos.cbegin(), followpos.cend());
+	}
+	_followpos_begin.emplace_back(_followpos.size());
+}
+
+bool PositionAutomaton::match(const std::string& input,
+                              std::size_t offset,
+                              int start_condition,
+                              Token& token) const
+{
+	token = Token{-1, offset, 0};
+
+	std::vector<leaf_pos_type> positions(_starts[start_condition]);
+	std::vector<leaf_pos_type> next_positions;
+	for (auto i = offset; !positions.empty(); ++i)
+	{
+		auto token_id = accepted_token(positions);
+		if (token_id != -1)
+		{
+			token.token_id = token_id;
+			token.length = i - offset;
+		}
+
+		if (i == input.length()) break;
+
+		auto byte = static_cast<unsigned char>(input[i]);
+		next_positions.clear();
+		for (auto pos : positions)
+		{
+			if (_ranges[pos].first <= byte && byte <= _ranges[pos].second)
+			{
+				next_positions.insert(next_positions.end(),
+				                      _followpos.cbegin() + _followpos_begin[pos],
+				                      _followpos.cbegin() + _followpos_begin[pos + 1]);
+			}
+		}
+
+		std::sort(next_positions.begin(), next_positions.end());
+		next_positions.erase(std::unique(next_positions.begin(), next_positions.end()),
+		                     next_positions.end());
+		positions.swap(next_positions);
+	}
+
+	if (token.length == 0)
+	{
+		token.token_id = -1;
+		return false;
+	}
+	return true;
+}
+
+std::size_t PositionAutomaton::memory_bytes() const
+{
+	auto result = utility::memory_bytes(_starts) +
+	              utility::memory_bytes(_ranges) +
+	              utility::memory_bytes(_token_ids) +
+	              utility::memory_bytes(_followpos_begin) +
+	              utility::memory_bytes(_followpos);
+	for (const auto& start : _starts)
+	{
+		result += utility::memory_bytes(start);
+	}
+	return result;
+}
+
+int PositionAutomaton::accepted_token(const std::vector<leaf_pos_type>& positions) const
+{
+	int token_id = -1;
+	for (auto pos : positions)
+	{
+		if (_token_ids[pos] != -1 && (token_id == -1 || _token_ids[pos] < token_id))
+		{
+			token_id = _token_ids[pos];
+		}
+	}
+	return token_id;
+}
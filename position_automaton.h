@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+
+#include "regex_tree.h"
+#include "token.h"
+
+/**
+ * A class simulating the rules directly over the followpos sets of an
+ * augmented regular expression tree. The current state of a match is the
+ * set of positions that may match the next byte, so the memory used does
+ * not depend on the number of states the DFA of the rules would have,
+ * while each byte costs a walk over the set.
+ */
+class PositionAutomaton
+{
+public:
+	using leaf_pos_type = AugmentedRegexTree::leaf_pos_type;
+
+
+	/**
+	 * @param tree augmented regular expression tree
+	 */
+	explicit PositionAutomaton(const AugmentedRegexTree& tree);
+
+	/**
+	 * @param tree augmented regular expression tree
+	 * @param start_conditions the ids of the rules active in each start
+	 *                         condition, as for DFA
+	 */
+	PositionAutomaton(const AugmentedRegexTree& tree,
+	                  const std::vector<std::vector<int>>& start_conditions);
+
+	/**
+	 * The number of start conditions.
+	 */
+	int start_conditions_count() const
+	{ return _starts.size(); }
+
+	/**
+	 * Match the longest token at a given offset.
+	 * @param input the input
+	 * @param offset the offset to match at
+	 * @param start_condition the index of the start condition
+	 * @param token the matched token
+	 * @return true when a non empty token is matched
+	 */
+	bool match(const std::string& input,
+	           std::size_t offset,
+	           int start_condition,
+	           Token& token) const;
+
+	/**
+	 * Approximate heap bytes used by the automaton.
+	 */
+	std::size_t memory_bytes() const;
+
+private:
+	/**
+	 * The token accepted by a set of positions, the rule that comes first
+	 * wins, -1 if no rule is accepted.
+	 */
+	int accepted_token(const std::vector<leaf_pos_type>& positions) const;
+
+
+	std::vector<std::vector<leaf_pos_type>> _starts; /**< The start positions of each start condition */
+	/**
+	 * The bytes matched by each position, the end markers match none
+	 */
+	std::vector<std::pair<unsigned char, unsigned char>> _ranges;
+	std::vector<int> _token_ids; /**< The rule of each end marker, -1 for the other positions */
+	std::vector<std::size_t> _followpos_begin; /**< Where the followpos of each position starts in _followpos */
+	std::vector<leaf_pos_type> _followpos; /**< The followpos sets, one after another */
+};
@@ -1,24 +1,175 @@
 #include "regex.h"
 
+#include <cctype>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "utf8.h"
+
+namespace
+{
+
+/**
+ * The character denoted by an escape sequence.
+ */
+char unescape(char c)
+{
+	switch (c)
+	{
+		case 'n': return '\n';
+		case 'r': return '\r';
+		case 't': return '\t';
+		default:  return c;
+	}
+}
+
+/**
+ * The length of the unescaped UTF-8 sequence starting at a given position.
+ * @throw std::invalid_argument if the bytes are not valid UTF-8
+ */
+std::size_t literal_length(const std::string& regex, std::size_t pos)
+{
+	auto length = utf8::sequence_length(regex, pos);
+	if (length == 1 && static_cast<unsigned char>(regex[pos]) >= 0x80)
+		throw std::invalid_argument("invalid UTF-8 in regular expression: " + regex);
+	return length;
+}
+
+/**
+ * The end of a `{m}`, `{m,}` or `{m,n}` operator starting at a given position.
+ * @return the position past the closing brace, or pos if there is no operator
+ */
+std::size_t repeat_end(const std::string& regex, std::size_t pos)
+{
+	auto i = pos + 1;
+	auto digits = [&regex, &i]
+	{
+		auto start = i;
+		while (i < regex.length() && std::isdigit(static_cast<unsigned char>(regex[i]))) ++i;
+		return i > start;
+	};
+
+	if (!digits()) return pos;
+	if (i < regex.length() && regex[i] == ',')
+	{
+		++i;
+		digits();
+	}
+	return i < regex.length() && regex[i] == '}' ? i + 1 : pos;
+}
+
+/**
+ * Parse the count of a repeat operator.
+ * @param pos the position of the first digit, moved past the last one
+ * @throw std::length_error if the count does not fit in an int
+ */
+int repeat_count(const std::string& symbol, std::size_t& pos)
+{
+	int count = 0;
+	for (; pos < symbol.length() && std::isdigit(static_cast<unsigned char>(symbol[pos])); ++pos)
+	{
+		int digit = symbol[pos] - '0';
+		if (count > (std::numeric_limits<int>::max() - digit) / 10)
+			throw std::length_error("repeat count exceeds the limit");
+		count = count * 10 + digit;
+	}
+	return count;
+}
+
+/**
+ * The end of a bracket class starting at a given position.
+ * @return the position past the closing bracket
+ */
+std::size_t class_end(const std::string& regex, std::size_t pos)
+{
+	auto i = pos + 1;
+	if (i < regex.length() && regex[i] == '^') ++i;
+	if (i < regex.length() && regex[i] == ']') ++i;
+
+	for (; i < regex.length(); ++i)
+	{
+		if (regex[i] == '\\') ++i;
+		else if (regex[i] == ']') return i + 1;
+	}
+	throw std::invalid_argument("unterminated bracket class: " + regex.substr(pos));
+}
+
+}
+
 Regex::Regex(const std::string& regex)
 {
 	for (std::size_t i = 0; i < regex.length();)
 	{
-		if (i + 2 < regex.length() && regex[i + 1] == '-')
+		// \.
+		if (regex[i] == '\\' && i + 1 < regex.length())
+		{
+			auto length = utf8::sequence_length(regex, i + 1);
+			if (length == 1)
+			{
+				auto c = unescape(regex[i + 1]);
+				_symbols.emplace_back(Symbol::byte_range(c, c));
+			}
+			else
+			{
+				_symbols.emplace_back(regex.substr(i + 1, length));
+			}
+			i += 1 + length;
+			continue;
+		}
+
+		// [...]
+		if (regex[i] == '[')
+		{
+			auto end = class_end(regex, i);
+			_symbols.emplace_back(regex.substr(i, end - i));
+			i = end;
+			continue;
+		}
+
+		// {m,n}
+		if (regex[i] == '{' && repeat_end(regex, i) != i)
 		{
-			_symbols.emplace_back(regex.substr(i, 3));
-			i += 3;
+			auto end = repeat_end(regex, i);
+			_symbols.emplace_back(regex.substr(i, end - i));
+			i = end;
+			continue;
+		}
+
+		auto first_length = literal_length(regex, i);
+		auto dash = i + first_length;
+
+		if (dash + 1 < regex.length() && regex[dash] == '-')
+		{
+			auto last_length = literal_length(regex, dash + 1);
+			_symbols.emplace_back(regex.substr(i, first_length + 1 + last_length));
+			i = dash + 1 + last_length;
 		}
 		else
 		{
-			_symbols.emplace_back(regex[i]);
-			++i;
+			_symbols.emplace_back(regex.substr(i, first_length));
+			i += first_length;
 		}
 	}
 }
 
 Regex::Symbol::Symbol(const std::string& symbol)
 {
+	// A brace not starting a valid repeat operator is an ordinary symbol,
+	// such as the range {-}
+	if (symbol.length() > 1 &&
+	    (symbol.front() == '[' ||
+	     (symbol.front() == '{' && repeat_end(symbol, 0) == symbol.length())))
+	{
+		_symbol = symbol;
+		_type = symbol.front() == '[' ? Type::CLASS : Type::REPEAT;
+
+		// Validate the symbol
+		if (is_class()) code_point_ranges();
+		else repeat_bounds();
+		return;
+	}
+
 	switch (symbol.length())
 	{
 		case 0:
@@ -34,12 +185,20 @@ Regex::Symbol::Symbol(const std::string& symbol)
 				case '*':
 					_type = Type::KLEEN_STAR;
 					break;
+				case '+':
+				case '?':
+					_symbol = symbol;
+					_type = Type::REPEAT;
+					break;
 				case '(':
 					_type = Type::OPEN_PAREN;
 					break;
 				case ')':
 					_type = Type::CLOSE_PAREN;
 					break;
+				case '#':
+					_type = Type::END_MARKER;
+					break;
 				default:
 					_symbol = symbol;
 					_type = Type::CHAR;
@@ -47,16 +206,148 @@ Regex::Symbol::Symbol(const std::string& symbol)
 			break;
 
 		case 3:
-			if (symbol[1] != '-') throw std::exception();
-
+			if (symbol[1] == '-')
+			{
+				_symbol = symbol;
+				_type = Type::RANGE;
+				break;
+			}
+			// A single code point of three bytes
+			// fall through
+		default:
 			_symbol = symbol;
-			_type = Type::RANGE;
-			break;
+			_type = Type::CODE_POINT_RANGE;
 
-		default:
-			// TODO: change exception
-			throw std::exception();
+			// Validate the symbol
+			code_point_ranges();
+	}
+}
+
+Regex::Symbol Regex::Symbol::byte_range(unsigned char first, unsigned char last)
+{
+	if (first == last)
+		return Symbol(std::string(1, first), Type::CHAR);
+
+	return Symbol({static_cast<char>(first), '-', static_cast<char>(last)},
+	              Type::RANGE);
+}
+
+std::vector<std::pair<char32_t, char32_t>> Regex::Symbol::code_point_ranges() const
+{
+	using range_type = std::pair<char32_t, char32_t>;
+
+	if (_type == Type::CODE_POINT_RANGE)
+	{
+		std::size_t pos = 0;
+		auto first = utf8::decode(_symbol, pos);
+		auto last = first;
+
+		if (pos < _symbol.length())
+		{
+			if (_symbol[pos] != '-' || pos + 1 == _symbol.length())
+				throw std::invalid_argument("invalid code point range: " + _symbol);
+
+			++pos;
+			last = utf8::decode(_symbol, pos);
+		}
+
+		if (pos != _symbol.length() || first > last)
+			throw std::invalid_argument("invalid code point range: " + _symbol);
+
+		return {range_type(first, last)};
 	}
+
+	if (_type != Type::CLASS)
+		throw std::invalid_argument("not a code point range nor a class: " + to_string());
+
+	// Everything between the brackets
+	auto end = _symbol.length() - 1;
+	std::size_t pos = 1;
+
+	auto next = [this, &pos]
+	{
+		if (_symbol[pos] == '\\')
+		{
+			++pos;
+			if (utf8::sequence_length(_symbol, pos) == 1)
+				return static_cast<char32_t>(static_cast<unsigned char>(unescape(_symbol[pos++])));
+		}
+		else
+		{
+			// Unescaped bytes must be valid UTF-8
+			literal_length(_symbol, pos);
+		}
+		return utf8::decode(_symbol, pos);
+	};
+
+	bool negated = pos < end && _symbol[pos] == '^';
+	if (negated) ++pos;
+
+	std::vector<range_type> ranges;
+	while (pos < end)
+	{
+		auto first = next();
+		auto last = first;
+		if (pos + 1 < end && _symbol[pos] == '-')
+		{
+			++pos;
+			last = next();
+		}
+
+		if (first > last)
+			throw std::invalid_argument("invalid range in bracket class: " + _symbol);
+
+		ranges.emplace_back(first, last);
+	}
+
+	std::sort(ranges.begin(), ranges.end());
+
+	std::vector<range_type> result;
+	for (const auto& range : ranges)
+	{
+		if (!result.empty() && range.first <= result.back().second + 1)
+			result.back().second = std::max(result.back().second, range.second);
+		else
+			result.emplace_back(range);
+	}
+
+	if (negated)
+	{
+		std::vector<range_type> complement;
+		char32_t first = 0;
+		for (const auto& range : result)
+		{
+			if (range.first > first) complement.emplace_back(first, range.first - 1);
+			first = range.second + 1;
+		}
+		if (first <= utf8::max_code_point) complement.emplace_back(first, utf8::max_code_point);
+		result.swap(complement);
+	}
+
+	if (result.empty())
+		throw std::invalid_argument("empty bracket class: " + _symbol);
+
+	return result;
+}
+
+std::pair<int, int> Regex::Symbol::repeat_bounds() const
+{
+	if (_type != Type::REPEAT)
+		throw std::invalid_argument("not a repeat operator: " + to_string());
+
+	if (_symbol == "+") return std::make_pair(1, -1);
+	if (_symbol == "?") return std::make_pair(0, 1);
+
+	std::size_t pos = 1;
+	auto min = repeat_count(_symbol, pos);
+	auto max = _symbol[pos] == '}' ? min :
+	           _symbol[++pos] == '}' ? -1 :
+	           repeat_count(_symbol, pos);
+
+	if (max != -1 && min > max)
+		throw std::invalid_argument("invalid repeat bounds: " + _symbol);
+
+	return std::make_pair(min, max);
 }
 
 std::string Regex::Symbol::to_string() const
@@ -68,6 +359,7 @@ std::string Regex::Symbol::to_string() const
 		case Type::CLOSE_PAREN: return ")";
 		case Type::KLEEN_STAR:  return "*";
 		case Type::UNION_OP:    return "|";
+		case Type::END_MARKER:  return "#";
 		default:                return _symbol;
 	}
 }
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <string>
+#include <utility>
 
 class Regex
 {
@@ -31,9 +32,21 @@ public:
 		bool is_range() const
 		{ return _type == Symbol::Type::RANGE; }
 
+		bool is_code_point_range() const
+		{ return _type == Symbol::Type::CODE_POINT_RANGE; }
+
+		bool is_class() const
+		{ return _type == Symbol::Type::CLASS; }
+
+		bool is_end_marker() const
+		{ return _type == Symbol::Type::END_MARKER; }
+
 		bool is_kleen_star() const
 		{ return _type == Symbol::Type::KLEEN_STAR; }
 
+		bool is_repeat() const
+		{ return _type == Symbol::Type::REPEAT; }
+
 		bool is_union_op() const
 		{ return _type == Symbol::Type::UNION_OP; }
 
@@ -45,13 +58,53 @@ public:
 
 		std::string to_string() const;
 
+		/**
+		 * Make a CHAR or RANGE symbol matching a range of bytes, whatever
+		 * their meaning in the regex syntax is.
+		 */
+		static Symbol byte_range(unsigned char first, unsigned char last);
+
+		/**
+		 * The first byte matched by a CHAR or RANGE symbol.
+		 */
+		unsigned char first() const
+		{ return static_cast<unsigned char>(_symbol.front()); }
+
+		/**
+		 * The last byte matched by a CHAR or RANGE symbol.
+		 */
+		unsigned char last() const
+		{ return static_cast<unsigned char>(_symbol.back()); }
+
+		bool contains(unsigned char byte) const
+		{ return (is_char() || is_range()) && first() <= byte && byte <= last(); }
+
+		/**
+		 * The code points matched by a CODE_POINT_RANGE or a CLASS symbol.
+		 * @return sorted and disjoint ranges of code points
+		 */
+		std::vector<std::pair<char32_t, char32_t>> code_point_ranges() const;
+
+		/**
+		 * The bounds of a REPEAT symbol: `+`, `?`, `{m}`, `{m,}` or `{m,n}`.
+		 * @return the minimum and maximum counts, the maximum is -1 if unbounded
+		 * @throw std::length_error if a count does not fit in an int
+		 */
+		std::pair<int, int> repeat_bounds() const;
+
 	private:
 		enum class Type
 		{
-			EPS, CHAR, RANGE, OPEN_PAREN, CLOSE_PAREN, KLEEN_STAR, UNION_OP
+			EPS, CHAR, RANGE, CODE_POINT_RANGE, CLASS, END_MARKER,
+			OPEN_PAREN, CLOSE_PAREN, KLEEN_STAR, REPEAT, UNION_OP
 		};
 
 
+		Symbol(const std::string& symbol, Type type)
+			: _symbol(symbol), _type(type)
+		{ }
+
+
 		std::string _symbol;
 		Type _type;
 	};
@@ -60,7 +113,7 @@ public:
 	explicit Regex(const std::string& regex);
 
 
-	std::vector<Symbol> symbols() const
+	const std::vector<Symbol>& symbols() const
 	{ return _symbols; }
 
 private:
@@ -1,5 +1,8 @@
 #include "regex_tree.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 #include "utility.h"
 
 RegexTree::RegexTree(const Regex& regex)
@@ -13,11 +16,22 @@ RegexTree::RegexTree(const Regex& regex)
 
 std::vector<RegexTree::symbol_type> RegexTree::labels() const
 {
-	std::unordered_set<symbol_type> result;
+	// The labels are byte ranges, so they are told apart by their bounds
+	std::vector<bool> seen(256 * 256);
+	std::vector<symbol_type> result;
 	for (const auto& leaf : _leaves)
-		if (leaf->label().to_string() != "#")
-		result.insert(leaf->label());
-	return std::vector<symbol_type>(result.cbegin(), result.cend());
+	{
+		const auto& label = leaf->label();
+		if (label.is_end_marker()) continue;
+
+		auto key = label.first() * 256 + label.last();
+		if (!seen[key])
+		{
+			seen[key] = true;
+			result.emplace_back(label);
+		}
+	}
+	return result;
 }
 
 RegexTree::Node::Node(Type type,
@@ -29,24 +43,31 @@ RegexTree::Node::Node(Type type,
 	{
 		case Type::CONCAT:
 		case Type::UNION:
-			_children.emplace_back(std::move(left));
-			_children.emplace_back(std::move(right));
+			_children[0] = std::move(left);
+			_children[1] = std::move(right);
 			break;
 		case Type::STAR:
-			_children.emplace_back(std::move(left));
+			_children[0] = std::move(left);
 			break;
 		default:
-			// TODO: throw another exception: can't make node of this type
-			throw std::exception();
+			throw std::invalid_argument("not a concat, union nor star node");
 	}
 }
 
+RegexTree::Node::Node(Type type, std::unique_ptr<Node> child, int min, int max)
+	: _type(type), _repeat_min(min), _repeat_max(max)
+{
+	if (type != Type::REPEAT)
+		throw std::invalid_argument("not a repeat node");
+
+	_children[0] = std::move(child);
+}
+
 RegexTree::Node::Node(Type type, symbol_type label, regex_id_type regex_id)
-	: _type(type), _label(label), _regex_id(regex_id)
+	: _type(type), _label(std::move(label)), _regex_id(regex_id)
 {
 	if (type != Type::LEAF)
-		// TODO: throw exception: can't make node of this type
-		throw std::exception();
+		throw std::invalid_argument("not a leaf node");
 }
 
 RegexTree::Node* RegexTree::Node::left() const
@@ -55,8 +76,7 @@ RegexTree::Node* RegexTree::Node::left() const
 	{
 		return _children[0].get();
 	}
-	// TODO: throw exception: node has no left child
-	throw std::exception();
+	throw std::logic_error("node has no left child");
 }
 
 RegexTree::Node* RegexTree::Node::right() const
@@ -65,28 +85,43 @@ RegexTree::Node* RegexTree::Node::right() const
 	{
 		return _children[1].get();
 	}
-	// TODO: throw exception: node has no right child
-	throw std::exception();
+	throw std::logic_error("node has no right child");
 }
 
 RegexTree::Node* RegexTree::Node::child() const
 {
-	if (_type == Type::STAR)
+	if (_type == Type::STAR || _type == Type::REPEAT)
 	{
 		return _children[0].get();
 	}
-	// TODO: throw exception: node has no children
-	throw std::exception();
+	throw std::logic_error("node has no single child");
 }
 
-RegexTree::symbol_type RegexTree::Node::label() const
+const RegexTree::symbol_type& RegexTree::Node::label() const
 {
 	if (_type == Type::LEAF)
 	{
 		return _label;
 	}
-	// TODO: throw exception: node is not a leaf
-	throw std::exception();
+	throw std::logic_error("node is not a leaf");
+}
+
+int RegexTree::Node::repeat_min() const
+{
+	if (_type == Type::REPEAT)
+	{
+		return _repeat_min;
+	}
+	throw std::logic_error("node is not a repeat node");
+}
+
+int RegexTree::Node::repeat_max() const
+{
+	if (_type == Type::REPEAT)
+	{
+		return _repeat_max;
+	}
+	throw std::logic_error("node is not a repeat node");
 }
 
 void RegexTree::calc_close_index(const std::vector<symbol_type>& symbols)
@@ -102,6 +137,9 @@ void RegexTree::calc_close_index(const std::vector<symbol_type>& symbols)
 		}
 		else if (symbols[i].is_close_paren())
 		{
+			if (stack.empty())
+				throw std::invalid_argument("unbalanced parentheses: unexpected ')'");
+
 			close_index[stack.back()] = i;
 			stack.pop_back();
 		}
@@ -114,8 +152,13 @@ AugmentedRegexTree::leaf_pos_type AugmentedRegexTree::Node::leaf_pos() const
 	{
 		return _leaf_pos;
 	}
-	// TODO: throw exception: node is not a leaf
-	throw std::exception();
+	throw std::logic_error("node is not a leaf");
+}
+
+AugmentedRegexTree::leaf_pos_type AugmentedRegexTree::Node::copies() const
+{
+	// x{m,} is x{m-1} followed by a looping copy
+	return repeat_max() == -1 ? std::max(repeat_min(), 1) : repeat_max();
 }
 
 AugmentedRegexTree::AugmentedRegexTree(const AugmentedRegex& regex)
@@ -126,21 +169,268 @@ AugmentedRegexTree::AugmentedRegexTree(const AugmentedRegex& regex)
 	// Set the root for the RegexTree
 	root = init<Node>(regex.symbols(), 0, regex.symbols().size());
 
-	for (std::size_t i = 0; i < _leaves.size(); ++i)
+	init_positions();
+}
+
+AugmentedRegexTree AugmentedRegexTree::reversed(bool unanchored) const
+{
+	AugmentedRegexTree result;
+
+	std::unique_ptr<Node> loop;
+	if (unanchored)
 	{
-		static_cast<Node*>(_leaves[i])->_leaf_pos = i;
+		auto leaf = std::make_unique<Node>(Node::Type::LEAF, symbol_type::byte_range(0, 255));
+		result._leaves.emplace_back(leaf.get());
+		loop = std::make_unique<Node>(Node::Type::STAR, std::move(leaf));
 	}
 
+	auto rules = reversed_subtree(static_cast<const Node*>(root.get()), result);
+	result.root = loop ?
+		std::make_unique<Node>(Node::Type::CONCAT, std::move(loop), std::move(rules)) :
+		std::move(rules);
+
+	result.init_positions();
+	return result;
+}
+
+std::unique_ptr<AugmentedRegexTree::Node> AugmentedRegexTree::reversed_subtree(
+	const AugmentedRegexTree::Node* node,
+	AugmentedRegexTree& tree) const
+{
+	// The leaves are added to the new tree in the order of its regex
+	if (node->is_leaf())
+	{
+		auto leaf = std::make_unique<Node>(Node::Type::LEAF, node->label(), node->regex_id());
+		tree._leaves.emplace_back(leaf.get());
+		return leaf;
+	}
+	if (node->is_concat())
+	{
+		// The factors of the whole chain of concatenations, in order
+		std::vector<const Node*> factors;
+		std::vector<const Node*> stack{node};
+		while (!stack.empty())
+		{
+			auto factor = stack.back();
+			stack.pop_back();
+			if (factor->is_concat())
+			{
+				stack.emplace_back(factor->right());
+				stack.emplace_back(factor->left());
+			}
+			else
+				factors.emplace_back(factor);
+		}
+
+		const Node* end_marker = nullptr;
+		if (factors.back()->is_leaf() && factors.back()->label().is_end_marker())
+		{
+			end_marker = factors.back();
+			factors.pop_back();
+		}
+
+		auto result = reversed_subtree(factors.back(), tree);
+		for (auto i = factors.size() - 1; i-- > 0;)
+		{
+			result = std::make_unique<Node>(Node::Type::CONCAT,
+			                                std::move(result),
+			                                reversed_subtree(factors[i], tree));
+		}
+		if (end_marker)
+		{
+			result = std::make_unique<Node>(Node::Type::CONCAT,
+			                                std::move(result),
+			                                reversed_subtree(end_marker, tree));
+		}
+		return result;
+	}
+	if (node->is_union())
+	{
+		auto left = reversed_subtree(node->left(), tree);
+		return std::make_unique<Node>(Node::Type::UNION,
+		                              std::move(left),
+		                              reversed_subtree(node->right(), tree));
+	}
+	if (node->is_star())
+	{
+		return std::make_unique<Node>(Node::Type::STAR,
+		                              reversed_subtree(node->child(), tree));
+	}
+	if (node->is_repeat())
+	{
+		return std::make_unique<Node>(Node::Type::REPEAT,
+		                              reversed_subtree(node->child(), tree),
+		                              node->repeat_min(),
+		                              node->repeat_max());
+	}
+	throw std::logic_error("node of undefined type");
+}
+
+void AugmentedRegexTree::init_positions()
+{
 	auto root_node = static_cast<Node*>(root.get());
 
+	// Give each copy of each leaf a position
+	_positions.resize(calc_positions(root_node, 0));
+	map_positions(root_node, 0);
+
+	for (leaf_pos_type i = 0; i < _positions.size(); ++i)
+	{
+		if (_positions[i]->label().is_end_marker()) _end_markers.emplace_back(i);
+	}
+
 	// Calculate nullable
 	calc_nullable(root_node);
 
 	// Calculate firstpos and lastpos
 	calc_first_last_pos(root_node);
+	_firstpos_root.assign(pool_begin(root_node->firstpos), pool_end(root_node->firstpos));
+
+	// Calculate followpos for the RegexTree. A first pass counts the
+	// positions added to each set, so that they are all allocated at once.
+	// They are added unordered and the sets are sorted once at the end.
+	std::vector<leaf_pos_type> ends(_positions.size());
+	calc_followpos(root_node, 0, ends, true);
+
+	_followpos_offsets.resize(_positions.size() + 1);
+	for (leaf_pos_type i = 0; i < _positions.size(); ++i)
+	{
+		_followpos_offsets[i + 1] = _followpos_offsets[i] + ends[i];
+		ends[i] = _followpos_offsets[i];
+	}
+	_followpos.resize(_followpos_offsets.back());
+	calc_followpos(root_node, 0, ends, false);
+
+	// The sets shrink when their duplicates are removed, so they are moved
+	// back one after another
+	auto out = _followpos.begin();
+	for (leaf_pos_type i = 0; i < _positions.size(); ++i)
+	{
+		auto begin = _followpos.begin() + _followpos_offsets[i];
+		auto end = _followpos.begin() + _followpos_offsets[i + 1];
+		std::sort(begin, end);
+		end = std::unique(begin, end);
+
+		_followpos_offsets[i] = out - _followpos.begin();
+		out = std::move(begin, end, out);
+	}
+	_followpos_offsets.back() = out - _followpos.begin();
+	_followpos.erase(out, _followpos.end());
+}
+
+AugmentedRegexTree::leaves_set_type AugmentedRegexTree::firstpos_rules(
+	const std::vector<regex_id_type>& regex_ids) const
+{
+	leaves_set_type result;
+	for (auto leaf_pos : firstpos_root())
+	{
+		if (std::find(regex_ids.cbegin(), regex_ids.cend(),
+		              position_regex_id(leaf_pos)) != regex_ids.cend())
+		{
+			result.emplace_back(leaf_pos);
+		}
+	}
+	return result;
+}
 
-	// Calculate followpos for the RegexTree
-	calc_followpos(root_node);
+AugmentedRegexTree::regex_id_type AugmentedRegexTree::position_regex_id(
+	leaf_pos_type leaf_pos) const
+{
+	// The leaves are in the order of the regex, so a rule is made of the
+	// positions up to its `#`
+	auto it = std::lower_bound(_end_markers.cbegin(), _end_markers.cend(), leaf_pos);
+	return it == _end_markers.cend() ? -1 : leaf_regex_id(*it);
+}
+
+std::size_t AugmentedRegexTree::tree_bytes() const
+{
+	return subtree_bytes(static_cast<const Node*>(root.get())) +
+	       utility::memory_bytes(_positions) +
+	       utility::memory_bytes(_end_markers) +
+	       utility::memory_bytes(_followpos_offsets) +
+	       utility::memory_bytes(_leaves) +
+	       utility::memory_bytes(close_index);
+}
+
+std::size_t AugmentedRegexTree::position_sets_bytes() const
+{
+	return utility::memory_bytes(_position_sets) +
+	       utility::memory_bytes(_firstpos_root) +
+	       utility::memory_bytes(_followpos);
+}
+
+std::size_t AugmentedRegexTree::subtree_bytes(const AugmentedRegexTree::Node* node) const
+{
+	std::size_t result = sizeof(Node);
+
+	if (node->is_union() || node->is_concat())
+	{
+		result += subtree_bytes(node->left());
+		result += subtree_bytes(node->right());
+	}
+	else if (node->is_star() || node->is_repeat())
+	{
+		result += subtree_bytes(node->child());
+	}
+	return result;
+}
+
+AugmentedRegexTree::leaf_pos_type AugmentedRegexTree::calc_positions(
+	AugmentedRegexTree::Node* node,
+	leaf_pos_type first)
+{
+	if (node->is_leaf())
+	{
+		node->_leaf_pos = first;
+		node->width = 1;
+	}
+	else if (node->is_union() || node->is_concat())
+	{
+		auto left_width = calc_positions(node->left(), first);
+		node->width = left_width + calc_positions(node->right(), first + left_width);
+	}
+	else if (node->is_star())
+	{
+		node->width = calc_positions(node->child(), first);
+	}
+	else if (node->is_repeat())
+	{
+		// The copies of the child are laid out one after another
+		auto child_width = calc_positions(node->child(), first);
+		auto copies = std::max<leaf_pos_type>(node->copies(), 1);
+		if (child_width > max_positions / copies)
+			throw std::length_error("number of positions exceeds the limit");
+
+		node->width = child_width * copies;
+	}
+	else
+		throw std::logic_error("node of undefined type");
+
+	if (first + node->width > max_positions)
+		throw std::length_error("number of positions exceeds the limit");
+
+	return node->width;
+}
+
+void AugmentedRegexTree::map_positions(AugmentedRegexTree::Node* node,
+                                       leaf_pos_type offset)
+{
+	if (node->is_leaf())
+		_positions[node->leaf_pos() + offset] = node;
+	else if (node->is_union() || node->is_concat())
+	{
+		map_positions(node->left(), offset);
+		map_positions(node->right(), offset);
+	}
+	else if (node->is_star())
+		map_positions(node->child(), offset);
+	else if (node->is_repeat())
+	{
+		for (leaf_pos_type i = 0; i < std::max<leaf_pos_type>(node->copies(), 1); ++i)
+		{
+			map_positions(node->child(), offset + i * node->child()->width);
+		}
+	}
 }
 
 void AugmentedRegexTree::calc_nullable(AugmentedRegexTree::Node* node)
@@ -148,7 +438,15 @@ void AugmentedRegexTree::calc_nullable(AugmentedRegexTree::Node* node)
 	if (node->is_leaf())
 		node->nullable = false;
 	else if (node->is_star())
+	{
+		calc_nullable(node->child());
 		node->nullable = true;
+	}
+	else if (node->is_repeat())
+	{
+		calc_nullable(node->child());
+		node->nullable = node->repeat_min() == 0 || node->child()->nullable;
+	}
 	else if (node->is_union() || node->is_concat())
 	{
 		calc_nullable(node->left());
@@ -159,16 +457,17 @@ void AugmentedRegexTree::calc_nullable(AugmentedRegexTree::Node* node)
 			node->nullable = node->left()->nullable & node->right()->nullable;
 	}
 	else
-		// TODO: throw exception: node is of undefined type
-		throw std::exception();
+		throw std::logic_error("node of undefined type");
 }
 
 void AugmentedRegexTree::calc_first_last_pos(AugmentedRegexTree::Node* node)
 {
 	if (node->is_leaf())
 	{
-		node->firstpos.insert(node->leaf_pos());
-		node->lastpos.insert(node->leaf_pos());
+		reserve_pool(1);
+		node->firstpos = PoolSlice{_position_sets.size(), 1};
+		node->lastpos = node->firstpos;
+		_position_sets.emplace_back(node->leaf_pos());
 	}
 	else if (node->is_union() || node->is_concat())
 	{
@@ -177,8 +476,8 @@ void AugmentedRegexTree::calc_first_last_pos(AugmentedRegexTree::Node* node)
 
 		if (node->is_union() || node->left()->nullable)
 		{
-			node->firstpos = utility::union_sets(node->left()->firstpos,
-			                                     node->right()->firstpos);
+			node->firstpos = union_slices(node->left()->firstpos,
+			                              node->right()->firstpos);
 		}
 		else
 		{
@@ -186,8 +485,8 @@ void AugmentedRegexTree::calc_first_last_pos(AugmentedRegexTree::Node* node)
 		}
 		if (node->is_union() || node->right()->nullable)
 		{
-			node->lastpos = utility::union_sets(node->left()->lastpos,
-			                                    node->right()->lastpos);
+			node->lastpos = union_slices(node->left()->lastpos,
+			                             node->right()->lastpos);
 		}
 		else
 		{
@@ -200,38 +499,140 @@ void AugmentedRegexTree::calc_first_last_pos(AugmentedRegexTree::Node* node)
 		node->firstpos = node->child()->firstpos;
 		node->lastpos = node->child()->lastpos;
 	}
+	else if (node->is_repeat())
+	{
+		// x{m,n} is x{m} followed by (x(x(...)?)?)?, so a copy is only
+		// matched after the previous one
+		auto child = node->child();
+		calc_first_last_pos(child);
+
+		auto copies = node->copies();
+		auto min = static_cast<leaf_pos_type>(node->repeat_min());
+
+		// The first copy starts the match, and so do the following ones
+		// as long as the copies before them can match the empty string
+		reserve_pool((child->nullable ? copies : 1) * child->firstpos.size);
+		node->firstpos.offset = _position_sets.size();
+		for (leaf_pos_type i = 0; i < copies; ++i)
+		{
+			for (auto pos = pool_begin(child->firstpos); pos != pool_end(child->firstpos); ++pos)
+				_position_sets.emplace_back(*pos + i * child->width);
+			if (!child->nullable) break;
+		}
+		node->firstpos.size = _position_sets.size() - node->firstpos.offset;
+
+		// A copy ends the match if the copies after it are optional or
+		// can match the empty string
+		reserve_pool((child->nullable || min == 0 ? copies : copies - min + 1) *
+		             child->lastpos.size);
+		node->lastpos.offset = _position_sets.size();
+		for (leaf_pos_type i = copies; i-- > 0;)
+		{
+			for (auto pos = pool_begin(child->lastpos); pos != pool_end(child->lastpos); ++pos)
+				_position_sets.emplace_back(*pos + i * child->width);
+			if (!child->nullable && i < min) break;
+		}
+		node->lastpos.size = _position_sets.size() - node->lastpos.offset;
+		std::sort(_position_sets.begin() + node->lastpos.offset, _position_sets.end());
+	}
 	else
-		// TODO: throw exception: node is of undefined type
-		throw std::exception();
+		throw std::logic_error("node of undefined type");
 }
 
-void AugmentedRegexTree::calc_followpos(AugmentedRegexTree::Node* node)
+void AugmentedRegexTree::reserve_pool(std::size_t size)
+{
+	auto needed = _position_sets.size() + size;
+	if (needed > _position_sets.capacity())
+		_position_sets.reserve(std::max(needed, 2 * _position_sets.capacity()));
+}
+
+AugmentedRegexTree::PoolSlice AugmentedRegexTree::union_slices(PoolSlice first,
+                                                               PoolSlice second)
+{
+	// The pool is not reallocated while the union is appended to it
+	reserve_pool(first.size + second.size);
+
+	auto offset = _position_sets.size();
+	std::set_union(pool_begin(first), pool_end(first),
+	               pool_begin(second), pool_end(second),
+	               std::back_inserter(_position_sets));
+	return PoolSlice{offset, _position_sets.size() - offset};
+}
+
+void AugmentedRegexTree::calc_followpos(AugmentedRegexTree::Node* node,
+                                        leaf_pos_type offset,
+                                        std::vector<leaf_pos_type>& ends,
+                                        bool count_only)
 {
 	if (node->is_union())
 	{
-		calc_followpos(node->left());
-		calc_followpos(node->right());
+		calc_followpos(node->left(), offset, ends, count_only);
+		calc_followpos(node->right(), offset, ends, count_only);
 	}
 	if (node->is_concat())
 	{
-		for (auto fpos : node->right()->firstpos)
+		add_followpos(node->left()->lastpos, offset,
+		              node->right()->firstpos, offset, ends, count_only);
+		calc_followpos(node->left(), offset, ends, count_only);
+		calc_followpos(node->right(), offset, ends, count_only);
+	}
+	if (node->is_star())
+	{
+		add_followpos(node->child()->lastpos, offset,
+		              node->child()->firstpos, offset, ends, count_only);
+		calc_followpos(node->child(), offset, ends, count_only);
+	}
+	if (node->is_repeat())
+	{
+		auto child = node->child();
+		auto copies = node->copies();
+
+		for (leaf_pos_type i = 0; i < copies; ++i)
 		{
-			for (auto lpos : node->left()->lastpos)
+			auto copy_offset = offset + i * child->width;
+
+			// Each copy is followed by the next one, or by any of the
+			// following ones if the copies between can match the
+			// empty string
+			for (auto j = i + 1; j < copies; ++j)
 			{
-				static_cast<Node*>(_leaves[lpos])->followpos.insert(fpos);
+				add_followpos(child->lastpos, copy_offset,
+				              child->firstpos, offset + j * child->width, ends, count_only);
+				if (!child->nullable) break;
 			}
+
+			calc_followpos(child, copy_offset, ends, count_only);
+		}
+
+		// The last copy of x{m,} loops
+		if (node->repeat_max() == -1)
+		{
+			auto copy_offset = offset + (copies - 1) * child->width;
+			add_followpos(child->lastpos, copy_offset,
+			              child->firstpos, copy_offset, ends, count_only);
 		}
-		calc_followpos(node->left());
-		calc_followpos(node->right());
 	}
-	if (node->is_star())
+}
+
+void AugmentedRegexTree::add_followpos(PoolSlice lastpos,
+                                       leaf_pos_type lastpos_offset,
+                                       PoolSlice firstpos,
+                                       leaf_pos_type firstpos_offset,
+                                       std::vector<leaf_pos_type>& ends,
+                                       bool count_only)
+{
+	for (auto lpos = pool_begin(lastpos); lpos != pool_end(lastpos); ++lpos)
 	{
-		for (auto lpos : node->child()->lastpos)
+		auto& end = ends[*lpos + lastpos_offset];
+		if (count_only)
+		{
+			end += firstpos.size;
+			continue;
+		}
+
+		for (auto fpos = pool_begin(firstpos); fpos != pool_end(firstpos); ++fpos)
 		{
-			static_cast<Node*>(_leaves[lpos])->followpos.insert(
-				node->child()->firstpos.cbegin(),
-				node->child()->firstpos.cend());
+			_followpos[end++] = *fpos + firstpos_offset;
 		}
-		calc_followpos(node->child());
 	}
 }
@@ -2,9 +2,11 @@
 
 #include <vector>
 #include <memory>
-#include <unordered_set>
+#include <stdexcept>
+#include <iterator>
 
 #include "regex.h"
+#include "utf8.h"
 
 class RegexTree
 {
@@ -14,6 +16,12 @@ public:
 	using regex_id_type = int;
 
 
+	/**
+	 * The maximum count accepted by a repeat operator.
+	 */
+	static constexpr int max_repeat_count = 1000;
+
+
 	RegexTree() { }
 
 	RegexTree(const Regex& regex);
@@ -31,7 +39,7 @@ protected:
 	public:
 		enum class Type
 		{
-			CONCAT, UNION, STAR, LEAF
+			CONCAT, UNION, STAR, REPEAT, LEAF
 		};
 
 
@@ -39,8 +47,12 @@ protected:
 		     std::unique_ptr<Node> left,
 		     std::unique_ptr<Node> right = nullptr);
 
+		Node(Type type, std::unique_ptr<Node> child, int min, int max);
+
 		Node(Type type, symbol_type label, regex_id_type regex_id = -1);
 
+		virtual ~Node() = default;
+
 
 		bool is_concat() const
 		{ return _type == Type::CONCAT; }
@@ -51,6 +63,9 @@ protected:
 		bool is_star() const
 		{ return _type == Type::STAR; }
 
+		bool is_repeat() const
+		{ return _type == Type::REPEAT; }
+
 		bool is_leaf() const
 		{ return _type == Type::LEAF; }
 
@@ -63,7 +78,14 @@ protected:
 
 		virtual Node* child() const;
 
-		symbol_type label() const;
+		const symbol_type& label() const;
+
+		int repeat_min() const;
+
+		/**
+		 * The maximum count of a repeat node, -1 if unbounded.
+		 */
+		int repeat_max() const;
 
 	protected:
 		Type _type;
@@ -71,7 +93,10 @@ protected:
 		symbol_type _label;
 		regex_id_type _regex_id;
 
-		std::vector<std::unique_ptr<Node>> _children;
+		int _repeat_min;
+		int _repeat_max;
+
+		std::unique_ptr<Node> _children[2]; /**< Held in the node, not on the heap */
 	};
 
 	template<typename T>
@@ -79,6 +104,22 @@ protected:
 	                        std::size_t begin,
 	                        std::size_t end);
 
+	/**
+	 * Build the subtree matching the UTF-8 encoding of the code points of a
+	 * CODE_POINT_RANGE or a CLASS symbol.
+	 */
+	template<typename T>
+	std::unique_ptr<T> init_code_points(const symbol_type& symbol);
+
+	/**
+	 * Build the union of byte sequences with their last suffix_length ranges
+	 * dropped. Sequences sharing a suffix share the leaves matching it.
+	 */
+	template<typename T>
+	std::unique_ptr<T> init_byte_sequences(
+		const std::vector<utf8::byte_sequence>& sequences,
+		std::size_t suffix_length);
+
 	void calc_close_index(const std::vector<symbol_type>& symbols);
 
 
@@ -91,22 +132,131 @@ protected:
 class AugmentedRegexTree : public RegexTree
 {
 public:
-	using leaves_set_type = std::unordered_set<leaf_pos_type>;
+	/**
+	 * A set of positions, sorted and without duplicates.
+	 */
+	using leaves_set_type = std::vector<leaf_pos_type>;
+
+	/**
+	 * A set of positions held by the tree, sorted and without duplicates.
+	 */
+	class LeavesRange
+	{
+	public:
+		LeavesRange(const leaf_pos_type* first, const leaf_pos_type* last)
+			: _first(first), _last(last)
+		{ }
+
+		const leaf_pos_type* begin() const
+		{ return _first; }
+
+		const leaf_pos_type* end() const
+		{ return _last; }
+
+		const leaf_pos_type* cbegin() const
+		{ return _first; }
+
+		const leaf_pos_type* cend() const
+		{ return _last; }
+
+		std::size_t size() const
+		{ return _last - _first; }
+
+		bool empty() const
+		{ return _first == _last; }
+
+	private:
+		const leaf_pos_type* _first;
+		const leaf_pos_type* _last;
+	};
+
+
+	/**
+	 * The maximum number of positions, counting each copy made by the repeat
+	 * operators.
+	 */
+	static constexpr leaf_pos_type max_positions = 1 << 20;
 
 
 	AugmentedRegexTree(const AugmentedRegex& regex);
 
+	/**
+	 * The tree of the reversed rules: each rule matches the reversed strings
+	 * of the same rule of this tree, and keeps its id.
+	 * @param unanchored prefix the reversed rules with a loop over any byte,
+	 *                   so that scanning an input backwards from its end
+	 *                   reaches an accepting state at each offset where a
+	 *                   match starts. The positions of the loop come
+	 *                   before the `#` of the first rule, so
+	 *                   position_regex_id() and firstpos_rules() count
+	 *                   them in it.
+	 */
+	AugmentedRegexTree reversed(bool unanchored = false) const;
+
+
+	/**
+	 * The number of positions. A leaf under repeat operators has a position
+	 * for each copy of it in the expanded regex.
+	 */
+	leaf_pos_type positions_count() const
+	{ return _positions.size(); }
+
+	const leaves_set_type& firstpos_root() const
+	{ return _firstpos_root; }
+
+	/**
+	 * The firstpos of the root restricted to some rules, where the rules
+	 * are the alternatives ending with a `#`.
+	 * @param regex_ids the ids of the rules
+	 */
+	leaves_set_type firstpos_rules(const std::vector<regex_id_type>& regex_ids) const;
+
+	/**
+	 * The number of rules, where the rules are the alternatives ending
+	 * with a `#`.
+	 */
+	regex_id_type rules_count() const
+	{ return _end_markers.empty() ? 0 : leaf_regex_id(_end_markers.back()) + 1; }
+
+	/**
+	 * The id of the rule a position belongs to.
+	 */
+	regex_id_type position_regex_id(leaf_pos_type leaf_pos) const;
+
+	LeavesRange followpos(leaf_pos_type leaf_pos) const
+	{
+		return LeavesRange(_followpos.data() + _followpos_offsets[leaf_pos],
+		                   _followpos.data() + _followpos_offsets[leaf_pos + 1]);
+	}
+
+	const symbol_type& label(leaf_pos_type leaf_pos) const
+	{ return _positions[leaf_pos]->label(); }
 
-	leaves_set_type firstpos_root() const
-	{ return static_cast<Node*>(root.get())->firstpos; }
+	regex_id_type leaf_regex_id(leaf_pos_type leaf_pos) const
+	{ return _positions[leaf_pos]->regex_id(); }
 
-	leaves_set_type followpos(leaf_pos_type leaf_pos) const
-	{ return static_cast<Node*>(_leaves[leaf_pos])->followpos; }
+	/**
+	 * Approximate heap bytes used by the nodes of the tree and the table
+	 * of positions.
+	 */
+	std::size_t tree_bytes() const;
 
-	symbol_type label(leaf_pos_type leaf_pos) const
-	{ return static_cast<Node*>(_leaves[leaf_pos])->label(); }
+	/**
+	 * Approximate heap bytes used by the firstpos, lastpos and followpos
+	 * sets.
+	 */
+	std::size_t position_sets_bytes() const;
 
 protected:
+	/**
+	 * A set of positions in the pool of the firstpos and lastpos sets.
+	 */
+	struct PoolSlice
+	{
+		std::size_t offset;
+		std::size_t size;
+	};
+
 	class Node : public RegexTree::Node
 	{
 	public:
@@ -124,27 +274,112 @@ protected:
 
 		leaf_pos_type leaf_pos() const;
 
+		/**
+		 * The number of copies of the child of a repeat node.
+		 */
+		leaf_pos_type copies() const;
+
 
 		bool nullable;
 
-		leaves_set_type firstpos;
-		leaves_set_type lastpos;
-		leaves_set_type followpos;
+		leaf_pos_type width; /**< The number of positions in the subtree */
+
+		// Positions of the first copy of the subtree, the positions of
+		// the other copies are shifted by a multiple of the child width
+		// of the repeat nodes above. A node whose set is the one of a
+		// child shares its slice.
+		PoolSlice firstpos;
+		PoolSlice lastpos;
 
 	private:
-		friend AugmentedRegexTree::AugmentedRegexTree(
-			const AugmentedRegex& regex);
+		friend class AugmentedRegexTree;
 
 
 		leaf_pos_type _leaf_pos;
 	};
 
 
+	AugmentedRegexTree() { }
+
+	/**
+	 * Calculate the positions of the tree with their sets, once the nodes
+	 * are built.
+	 */
+	void init_positions();
+
+	/**
+	 * Copy a subtree with its concatenations reversed, except for the `#`
+	 * ending a rule, which stays at the end.
+	 */
+	std::unique_ptr<Node> reversed_subtree(const Node* node,
+	                                       AugmentedRegexTree& tree) const;
+
+	leaf_pos_type calc_positions(Node* node, leaf_pos_type first);
+
+	void map_positions(Node* node, leaf_pos_type offset);
+
+
 	void calc_nullable(Node* node);
 
 	void calc_first_last_pos(Node* node);
 
-	void calc_followpos(Node* node);
+	/**
+	 * Add the followpos of a subtree.
+	 * @param ends the end of each followpos in _followpos, moved past the
+	 *             positions added
+	 * @param count_only only move the ends, when sizing the sets
+	 */
+	void calc_followpos(Node* node, leaf_pos_type offset,
+	                    std::vector<leaf_pos_type>& ends, bool count_only);
+
+	/**
+	 * The heap bytes of the nodes of a subtree.
+	 */
+	std::size_t subtree_bytes(const Node* node) const;
+
+	/**
+	 * Add the shifted firstpos to the followpos of the shifted lastpos.
+	 * @param ends, count_only as for calc_followpos
+	 */
+	void add_followpos(PoolSlice lastpos,
+	                   leaf_pos_type lastpos_offset,
+	                   PoolSlice firstpos,
+	                   leaf_pos_type firstpos_offset,
+	                   std::vector<leaf_pos_type>& ends,
+	                   bool count_only);
+
+	/**
+	 * Make room for a set of a given size at the end of the pool, growing
+	 * it geometrically.
+	 */
+	void reserve_pool(std::size_t size);
+
+	/**
+	 * Append the union of two sets of the pool to it.
+	 */
+	PoolSlice union_slices(PoolSlice first, PoolSlice second);
+
+	const leaf_pos_type* pool_begin(PoolSlice slice) const
+	{ return _position_sets.data() + slice.offset; }
+
+	const leaf_pos_type* pool_end(PoolSlice slice) const
+	{ return _position_sets.data() + slice.offset + slice.size; }
+
+
+	std::vector<Node*> _positions; /**< The leaf of each position */
+	std::vector<leaf_pos_type> _end_markers; /**< The positions of the `#` leaves */
+	/**
+	 * The firstpos and lastpos sets of the nodes, one after another, so
+	 * that they take a few allocations instead of two per node
+	 */
+	std::vector<leaf_pos_type> _position_sets;
+	leaves_set_type _firstpos_root;
+	/**
+	 * The followpos sets one after another, the set of a position starting
+	 * at its offset and ending at the offset of the next one
+	 */
+	std::vector<leaf_pos_type> _followpos;
+	std::vector<std::size_t> _followpos_offsets;
 };
 
 template<typename T>
@@ -155,16 +390,29 @@ std::unique_ptr<T> RegexTree::init(
 {
 	if (begin >= end)
 	{
-		// TODO: report error: invalid regular expression
-		throw std::exception();
+		throw std::invalid_argument("invalid regular expression: empty operand");
 	}
 
 	// .
 	if (begin + 1 == end)
 	{
-		// TODO: Move this somewhere else
+		if (symbols[begin].is_code_point_range() || symbols[begin].is_class())
+		{
+			return init_code_points<T>(symbols[begin]);
+		}
+
+		// An operator left without its operands, as in *a, a|+ or (|)
+		const auto& symbol = symbols[begin];
+		if (symbol.is_kleen_star() || symbol.is_repeat() || symbol.is_union_op() ||
+		    symbol.is_open_paren() || symbol.is_close_paren())
+		{
+			throw std::invalid_argument("invalid regular expression: operator without operand: " +
+			                            symbol.to_string());
+		}
+
+		// The end markers are numbered in the order of the regex
 		regex_id_type regex_id = -1;
-		if (symbols[begin].to_string() == "#")
+		if (symbols[begin].is_end_marker())
 		{
 			for (std::size_t i = 0; i <= begin; ++i)
 			{
@@ -178,6 +426,9 @@ std::unique_ptr<T> RegexTree::init(
 		return leaf;
 	}
 
+	// The subtrees are built from left to right, so the leaves are kept in
+	// the order of the regex
+
 	// ...|...
 	int depth = 0;
 	for (std::size_t i = begin; i < end; ++i)
@@ -186,71 +437,147 @@ std::unique_ptr<T> RegexTree::init(
 		depth -= symbols[i].is_close_paren();
 		if (symbols[i].is_union_op() && depth == 0)
 		{
+			auto left = init<T>(symbols, begin, i);
+			auto right = init<T>(symbols, i + 1, end);
 			return std::make_unique<T>(T::Type::UNION,
-			                           init<T>(symbols, begin, i),
-			                           init<T>(symbols, i + 1, end));
+			                           std::move(left),
+			                           std::move(right));
 		}
 	}
 
+	// The first factor: (...) or a single symbol, followed by any number
+	// of postfix operators
+	auto factor_end = begin + 1;
 	if (symbols[begin].is_open_paren())
 	{
-		auto close = close_index[begin];
-
-		// (...)*...
-		if (close + 1 < end && symbols[close + 1].is_kleen_star())
+		if (close_index[begin] >= end)
 		{
-			// (...)*...
-			if (close + 2 < end)
-			{
-				return std::make_unique<T>(T::Type::CONCAT,
-				                           init<T>(symbols, begin, close + 2),
-				                           init<T>(symbols, close + 2, end));
-			}
-			// (...)*
-			else
-			{
-				return std::make_unique<T>(T::Type::STAR,
-				                           init<T>(symbols, begin + 1, close));
-			}
+			throw std::invalid_argument("unbalanced parentheses: missing ')'");
 		}
-		// (...)...
-		else
+		factor_end = close_index[begin] + 1;
+	}
+	while (factor_end < end &&
+	       (symbols[factor_end].is_kleen_star() || symbols[factor_end].is_repeat()))
+	{
+		++factor_end;
+	}
+
+	// ......
+	if (factor_end < end)
+	{
+		auto left = init<T>(symbols, begin, factor_end);
+		auto right = init<T>(symbols, factor_end, end);
+		return std::make_unique<T>(T::Type::CONCAT,
+		                           std::move(left),
+		                           std::move(right));
+	}
+
+	// ...*
+	if (symbols[end - 1].is_kleen_star())
+	{
+		return std::make_unique<T>(T::Type::STAR,
+		                           init<T>(symbols, begin, end - 1));
+	}
+
+	// ...+ ...? ...{m,n}
+	if (symbols[end - 1].is_repeat())
+	{
+		auto bounds = symbols[end - 1].repeat_bounds();
+		if (bounds.first > max_repeat_count || bounds.second > max_repeat_count)
 		{
-			// (...)...
-			if (close + 1 < end)
-			{
-				return std::make_unique<T>(T::Type::CONCAT,
-				                           init<T>(symbols, begin + 1, close),
-				                           init<T>(symbols, close + 1, end));
-			}
-			// (...)
-			else
-			{
-				return init<T>(symbols, begin + 1, close);
-			}
+			throw std::length_error("repeat count exceeds the limit");
 		}
+		return std::make_unique<T>(T::Type::REPEAT,
+		                           init<T>(symbols, begin, end - 1),
+		                           bounds.first,
+		                           bounds.second);
 	}
 
-	// .*...
-	if (begin + 1 < end && symbols[begin + 1].is_kleen_star())
+	// (...)
+	return init<T>(symbols, begin + 1, end - 1);
+}
+
+template<typename T>
+std::unique_ptr<T> RegexTree::init_code_points(const symbol_type& symbol)
+{
+	std::vector<utf8::byte_sequence> sequences;
+	for (const auto& range : symbol.code_point_ranges())
+	{
+		auto range_sequences = utf8::byte_sequences(range.first, range.second);
+		sequences.insert(sequences.end(),
+		                 std::make_move_iterator(range_sequences.begin()),
+		                 std::make_move_iterator(range_sequences.end()));
+	}
+
+	// Only surrogates, which have no UTF-8 encoding
+	if (sequences.empty())
+		throw std::invalid_argument("no UTF-8 encoding: " + symbol.to_string());
+
+	return init_byte_sequences<T>(sequences, 0);
+}
+
+template<typename T>
+std::unique_ptr<T> RegexTree::init_byte_sequences(
+	const std::vector<utf8::byte_sequence>& sequences,
+	std::size_t suffix_length)
+{
+	auto make_leaf = [this](const utf8::byte_range& range)
 	{
-		// .*...
-		if (begin + 2 < end)
+		auto leaf = std::make_unique<T>(T::Type::LEAF,
+		                                symbol_type::byte_range(range.first,
+		                                                        range.second));
+		_leaves.emplace_back(leaf.get());
+		return leaf;
+	};
+
+	std::unique_ptr<T> result;
+	std::vector<bool> grouped(sequences.size());
+
+	for (std::size_t i = 0; i < sequences.size(); ++i)
+	{
+		if (grouped[i]) continue;
+
+		// Group the sequences by the range preceding the common suffix
+		auto range = sequences[i][sequences[i].size() - 1 - suffix_length];
+		bool complete = false;
+		std::vector<utf8::byte_sequence> longer;
+
+		for (std::size_t j = i; j < sequences.size(); ++j)
 		{
-			return std::make_unique<T>(T::Type::CONCAT,
-			                           init<T>(symbols, begin, begin + 2),
-			                           init<T>(symbols, begin + 2, end));
+			if (grouped[j] ||
+			    sequences[j][sequences[j].size() - 1 - suffix_length] != range)
+				continue;
+
+			grouped[j] = true;
+			if (sequences[j].size() == suffix_length + 1)
+				complete = true;
+			else
+				longer.emplace_back(sequences[j]);
 		}
-		// .*
-		else
+
+		std::unique_ptr<T> alternative;
+		if (!longer.empty())
 		{
-			return std::make_unique<T>(T::Type::STAR,
-			                           init<T>(symbols, begin, begin + 1));
+			auto prefix = init_byte_sequences<T>(longer, suffix_length + 1);
+			alternative = std::make_unique<T>(T::Type::CONCAT,
+			                                  std::move(prefix),
+			                                  make_leaf(range));
 		}
+		if (complete)
+		{
+			alternative = alternative ?
+				std::make_unique<T>(T::Type::UNION,
+				                    make_leaf(range),
+				                    std::move(alternative)) :
+				make_leaf(range);
+		}
+
+		result = result ?
+			std::make_unique<T>(T::Type::UNION,
+			                    std::move(result),
+			                    std::move(alternative)) :
+			std::move(alternative);
 	}
 
-	// ...
-	return std::make_unique<T>(T::Type::CONCAT,
-	                           init<T>(symbols, begin, begin + 1),
-	                           init<T>(symbols, begin + 1, end));
+	return result;
 }
@@ -0,0 +1,66 @@
+#include "rule_set.h"
+
+#include <algorithm>
+
+#include "regex.h"
+#include "regex_tree.h"
+
+int RuleSet::add_rule(const std::string& regex)
+{
+	// The rule is built before taking the lock, the other changes do not
+	// wait for it
+	auto rule_dfa = std::make_shared<DFA>(AugmentedRegexTree(AugmentedRegex(regex)));
+	rule_dfa->minimize();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto rule_id = _next_id++;
+	rule_dfa->remap_tokens({rule_id});
+
+	if (static_cast<std::size_t>(rule_id) == _capacity)
+	{
+		// Double the leaves, the old tree becomes the left half
+		auto capacity = std::max<std::size_t>(2 * _capacity, 1);
+		std::vector<dfa_ptr> nodes(2 * capacity);
+		for (std::size_t level = 1; level <= _capacity; level *= 2)
+		{
+			std::copy_n(_nodes.cbegin() + level, level, nodes.begin() + 2 * level);
+		}
+		nodes[1] = _dfa;
+		_nodes.swap(nodes);
+		_capacity = capacity;
+	}
+
+	_nodes[_capacity + rule_id] = rule_dfa;
+	update(rule_id);
+
+	return rule_id;
+}
+
+bool RuleSet::remove_rule(int rule_id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (rule_id < 0 || rule_id >= _next_id || !_nodes[_capacity + rule_id]) return false;
+
+	_nodes[_capacity + rule_id] = nullptr;
+	update(rule_id);
+
+	return true;
+}
+
+void RuleSet::update(std::size_t rule_id)
+{
+	for (auto node = (_capacity + rule_id) / 2; node > 0; node /= 2)
+	{
+		_nodes[node] = make_union(_nodes[2 * node], _nodes[2 * node + 1]);
+	}
+	std::atomic_store(&_dfa, _nodes[1]);
+}
+
+RuleSet::dfa_ptr RuleSet::make_union(const dfa_ptr& first, const dfa_ptr& second)
+{
+	if (!first) return second;
+	if (!second) return first;
+	return std::make_shared<DFA>(*first, *second);
+}
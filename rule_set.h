@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+
+#include "dfa.h"
+
+/**
+ * A set of rules that can be changed while other threads scan with it.
+ * The DFA of each rule is built once and kept, along with the unions of
+ * the DFAs of consecutive rules in a segment tree. A change rebuilds the
+ * unions on the path from its rule to the root only, so the other rules
+ * are never parsed nor determinized again.
+ *
+ * The scanners get the current DFA with dfa() and keep it as long as they
+ * scan with it, a change publishes a new DFA without waiting for them.
+ */
+class RuleSet
+{
+public:
+	/**
+	 * Add a rule, with the lowest priority.
+	 * @param regex the regular expression of the rule
+	 * @return the id of the rule, which is its token id
+	 */
+	int add_rule(const std::string& regex);
+
+	/**
+	 * Remove a rule.
+	 * @param rule_id the id of the rule
+	 * @return false if there is no such rule
+	 */
+	bool remove_rule(int rule_id);
+
+	/**
+	 * The DFA of the current rules, null when there are no rules.
+	 */
+	std::shared_ptr<const DFA> dfa() const
+	{ return std::atomic_load(&_dfa); }
+
+private:
+	using dfa_ptr = std::shared_ptr<const DFA>;
+
+
+	/**
+	 * Rebuild the unions above a rule and publish the new DFA.
+	 */
+	void update(std::size_t rule_id);
+
+	/**
+	 * The union of two DFAs, either of them may be null.
+	 */
+	static dfa_ptr make_union(const dfa_ptr& first, const dfa_ptr& second);
+
+
+	std::mutex _mutex; /**< Serializes the changes */
+	/**
+	 * The segment tree: the node i is the union of the nodes 2i and 2i+1,
+	 * the leaves are the DFAs of the rules by id, null once removed
+	 */
+	std::vector<dfa_ptr> _nodes;
+	std::size_t _capacity = 0; /**< The number of leaves */
+	int _next_id = 0;
+	dfa_ptr _dfa;
+};
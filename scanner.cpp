@@ -0,0 +1,232 @@
+#include "scanner.h"
+
+#include <array>
+
+namespace
+{
+
+const char checkpoint_magic[] = "SCK1";
+
+/**
+ * Append a number in little endian order.
+ */
+void put_number(std::string& out, std::uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; ++i)
+	{
+		out += static_cast<char>(value >> (8 * i) & 0xFF);
+	}
+}
+
+/**
+ * Read a number written by put_number().
+ * @param pos the offset to read at, moved past the number
+ */
+std::uint64_t get_number(const std::string& in, std::size_t& pos, int bytes)
+{
+	if (in.length() - pos < static_cast<std::size_t>(bytes))
+		throw std::invalid_argument("truncated scanner checkpoint");
+
+	std::uint64_t value = 0;
+	for (int i = 0; i < bytes; ++i)
+	{
+		value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in[pos++])) << (8 * i);
+	}
+	return value;
+}
+
+}
+
+std::string Scanner::Checkpoint::serialize() const
+{
+	std::string out(checkpoint_magic, 4);
+	put_number(out, fingerprint, 8);
+	put_number(out, static_cast<std::uint32_t>(start_condition), 4);
+	put_number(out, static_cast<std::uint32_t>(state), 4);
+	put_number(out, offset, 8);
+	put_number(out, lexeme.length(), 8);
+	out += lexeme;
+	return out;
+}
+
+Scanner::Checkpoint Scanner::Checkpoint::deserialize(const std::string& data)
+{
+	if (data.compare(0, 4, checkpoint_magic) != 0)
+		throw std::invalid_argument("not a scanner checkpoint");
+
+	std::size_t pos = 4;
+	Checkpoint checkpoint;
+	checkpoint.fingerprint = get_number(data, pos, 8);
+	checkpoint.start_condition = static_cast<std::int32_t>(get_number(data, pos, 4));
+	checkpoint.state = static_cast<std::int32_t>(get_number(data, pos, 4));
+	checkpoint.offset = get_number(data, pos, 8);
+
+	auto length = get_number(data, pos, 8);
+	if (data.length() - pos != length)
+		throw std::invalid_argument("truncated scanner checkpoint");
+	checkpoint.lexeme.assign(data, pos, length);
+
+	return checkpoint;
+}
+
+Scanner::Checkpoint Scanner::checkpoint() const
+{
+	if (!_dfa) throw std::logic_error("stream scanning needs a DFA");
+
+	return Checkpoint{_dfa->fingerprint(),
+	                  _start_condition,
+	                  _pending.empty() ? _start_state : _state,
+	                  _stream_offset,
+	                  _pending};
+}
+
+void Scanner::restore(const Checkpoint& checkpoint)
+{
+	if (!_dfa) throw std::logic_error("stream scanning needs a DFA");
+	if (checkpoint.fingerprint != _dfa->fingerprint())
+		throw std::invalid_argument("scanner checkpoint taken with other rules");
+	if (checkpoint.start_condition < 0 ||
+	    checkpoint.start_condition >= _dfa->start_conditions_count())
+		throw std::invalid_argument("invalid start condition in scanner checkpoint");
+	if (checkpoint.state < 0 || checkpoint.state >= _dfa->states_count())
+		throw std::invalid_argument("invalid state in scanner checkpoint");
+
+	set_start_condition(checkpoint.start_condition);
+
+	// The longest match is not part of the checkpoint, it is found again by
+	// running the lexeme, which must reach the state of the checkpoint
+	int state = _start_state;
+	int match_id = -1;
+	std::size_t match_length = 0;
+	for (std::size_t i = 0; i < checkpoint.lexeme.length() && state != DFA::reject_state; ++i)
+	{
+		state = _dfa->next(state, checkpoint.lexeme[i]);
+		if (state != DFA::reject_state && _dfa->token_id(state) != -1)
+		{
+			match_id = _dfa->token_id(state);
+			match_length = i + 1;
+		}
+	}
+	// A pending lexeme never reaches reject_state, its token is complete
+	// before
+	if (state == DFA::reject_state || state != checkpoint.state)
+		throw std::invalid_argument("scanner checkpoint does not match its lexeme");
+
+	_pending = checkpoint.lexeme;
+	_stream_offset = checkpoint.offset;
+	_state = state;
+	_match_id = match_id;
+	_match_length = match_length;
+}
+
+std::vector<Token> Scanner::tokenize(const std::string& input) const
+{
+	std::vector<Token> tokens;
+	scan(input, [&tokens](const Token& token) { tokens.emplace_back(token); });
+	return tokens;
+}
+
+std::vector<std::vector<Token>> Scanner::tokenize_batch(
+	const std::vector<std::string>& inputs) const
+{
+	// The scan of one input: the token being matched starts at start, pos
+	// is the next byte to read and the longest match so far ends at end.
+	// The tokens are written to buffer, which has room for a token per byte
+	struct Cursor
+	{
+		std::size_t input;
+		const char* data;
+		std::size_t length;
+		std::size_t start;
+		std::size_t pos;
+		std::size_t end;
+		int state;
+		int token_id;
+		std::vector<Token> buffer;
+		std::size_t count;
+	};
+
+	std::vector<std::vector<Token>> tokens(inputs.size());
+
+	// There is no table to interleave the loads of
+	if (_nfa)
+	{
+		for (std::size_t i = 0; i < inputs.size(); ++i)
+		{
+			tokens[i] = tokenize(inputs[i]);
+		}
+		return tokens;
+	}
+
+	std::size_t next_input = 0;
+	auto load = [this, &inputs, &next_input](Cursor& cursor)
+	{
+		// Empty inputs have no tokens
+		while (next_input < inputs.size() && inputs[next_input].empty()) ++next_input;
+		if (next_input == inputs.size()) return false;
+
+		const auto& input = inputs[next_input];
+		cursor.input = next_input++;
+		cursor.data = input.data();
+		cursor.length = input.length();
+		cursor.start = cursor.pos = cursor.end = 0;
+		cursor.state = _start_state;
+		cursor.token_id = -1;
+		if (cursor.buffer.size() < input.length()) cursor.buffer.resize(input.length());
+		cursor.count = 0;
+		return true;
+	};
+
+	std::array<Cursor, batch_lanes> cursors;
+	std::size_t lanes = 0;
+	while (lanes < batch_lanes && load(cursors[lanes])) ++lanes;
+
+	// The steps of the lanes are kept free of unpredictable branches, so a
+	// mispredicted branch of one lane does not discard the table loads
+	// already issued for the others
+	while (lanes > 0)
+	{
+		for (std::size_t lane = 0; lane < lanes; ++lane)
+		{
+			auto& cursor = cursors[lane];
+
+			auto token_id = _dfa->token_id(cursor.state);
+			cursor.end = token_id == -1 ? cursor.end : cursor.pos;
+			cursor.token_id = token_id == -1 ? cursor.token_id : token_id;
+
+			// data[length] is the terminating null character
+			auto state = _dfa->next(cursor.state, cursor.data[cursor.pos]);
+			state = cursor.pos < cursor.length ? state : DFA::reject_state;
+
+			// When the token is complete, write it and start the next one.
+			// A byte that does not start any token is a token of id -1
+			bool complete = state == DFA::reject_state;
+			bool unmatched = cursor.token_id == -1 || cursor.end == cursor.start;
+			auto end = unmatched ? cursor.start + 1 : cursor.end;
+
+			cursor.buffer[cursor.count] =
+				Token{unmatched ? -1 : cursor.token_id, cursor.start, end - cursor.start};
+			cursor.count += complete;
+
+			cursor.start = complete ? end : cursor.start;
+			cursor.pos = complete ? end : cursor.pos + 1;
+			cursor.state = complete ? _start_state : state;
+			cursor.token_id = complete ? -1 : cursor.token_id;
+
+			if (complete && cursor.start == cursor.length)
+			{
+				tokens[cursor.input].assign(cursor.buffer.cbegin(),
+				                            cursor.buffer.cbegin() + cursor.count);
+
+				// No inputs left: drop the lane
+				if (!load(cursor))
+				{
+					std::swap(cursor, cursors[--lanes]);
+					--lane;
+				}
+			}
+		}
+	}
+
+	return tokens;
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+#include "dfa.h"
+#include "position_automaton.h"
+#include "token.h"
+
+/**
+ * A class for splitting an input into tokens, taking the longest match at
+ * each step. The rule that comes first wins between matches of the same
+ * length.
+ */
+class Scanner
+{
+public:
+	/**
+	 * The point a stream scan reached between two chunks, from which the
+	 * scan resumes exactly, see checkpoint() and restore().
+	 */
+	struct Checkpoint
+	{
+		std::uint64_t fingerprint; /**< The DFA::fingerprint() of the rules */
+		int start_condition; /**< The current start condition */
+		int state; /**< The state of the DFA reached by the pending lexeme */
+		std::uint64_t offset; /**< The offset of the pending lexeme in the stream */
+		/**
+		 * The bytes after the last complete token, whose token depends on
+		 * the bytes to come
+		 */
+		std::string lexeme;
+
+		/**
+		 * Write the checkpoint in a portable binary form.
+		 */
+		std::string serialize() const;
+
+		/**
+		 * Read a checkpoint written by serialize().
+		 * @throw std::invalid_argument when the data is not a checkpoint
+		 */
+		static Checkpoint deserialize(const std::string& data);
+	};
+
+
+	/**
+	 * @param dfa the automaton of the rules, it must outlive the scanner
+	 */
+	explicit Scanner(const DFA& dfa)
+		: _dfa(&dfa), _nfa(nullptr), _start_condition(0), _start_state(dfa.start_state()),
+		  _stream_offset(0), _state(-1), _match_id(-1), _match_length(0)
+	{ }
+
+	/**
+	 * Scan without a DFA, for rules whose DFA exceeds its budget.
+	 * @param nfa the automaton of the rules, it must outlive the scanner
+	 */
+	explicit Scanner(const PositionAutomaton& nfa)
+		: _dfa(nullptr), _nfa(&nfa), _start_condition(0), _start_state(-1),
+		  _stream_offset(0), _state(-1), _match_id(-1), _match_length(0)
+	{ }
+
+	/**
+	 * Switch to another start condition of the DFA, the following tokens
+	 * are matched by its rules only.
+	 * @param start_condition the index of the start condition
+	 */
+	void set_start_condition(int start_condition)
+	{
+		_start_condition = start_condition;
+		if (_dfa) _start_state = _dfa->start_state(start_condition);
+	}
+
+	/**
+	 * Match the longest token at a given offset.
+	 * @param input the input
+	 * @param offset the offset to match at
+	 * @param token the matched token
+	 * @return true when a non empty token is matched
+	 */
+	bool match(const std::string& input, std::size_t offset, Token& token) const;
+
+	/**
+	 * Split a whole input into tokens with the current start condition. A
+	 * byte that does not start any token gives a token of id -1.
+	 * @param input the input
+	 * @return the tokens in order
+	 */
+	std::vector<Token> tokenize(const std::string& input) const;
+
+	/**
+	 * Split a whole input into tokens, as tokenize() does, passing each of
+	 * them to a handler instead of storing them. The handler is a template
+	 * parameter, so its call is inlined into the scan loop, see
+	 * make_token_handlers() for a handler per token id.
+	 * @tparam SkippedIds the ids of the tokens not passed to the handler,
+	 *                    such as whitespace and comments, tested with a
+	 *                    single mask known at compile time
+	 * @param input the input
+	 * @param handler a callable taking a const Token&
+	 */
+	template<int... SkippedIds, typename Handler>
+	void scan(const std::string& input, Handler&& handler) const;
+
+	/**
+	 * Split many independent inputs into tokens, as tokenize() does for
+	 * each of them. The inputs are scanned by batch_lanes cursors advanced
+	 * in lockstep, so the table loads of the cursors overlap instead of
+	 * waiting for each other.
+	 * @param inputs the inputs
+	 * @return the tokens of each input
+	 */
+	std::vector<std::vector<Token>> tokenize_batch(const std::vector<std::string>& inputs) const;
+
+	/**
+	 * The number of cursors advanced together by tokenize_batch().
+	 */
+	static constexpr std::size_t batch_lanes = 8;
+
+	/**
+	 * Scan the next chunk of a stream too large to be held at once, passing
+	 * the complete tokens to a handler as scan() does. A token is complete
+	 * once a byte that cannot extend it is read, so the bytes after the
+	 * last complete token are kept as the pending lexeme of the next chunk.
+	 * The offsets of the tokens are in the whole stream.
+	 * @param chunk the next bytes of the stream
+	 * @param handler a callable taking a const Token&
+	 * @throw std::logic_error when the scanner has no DFA
+	 */
+	template<int... SkippedIds, typename Handler>
+	void feed(const std::string& chunk, Handler&& handler);
+
+	/**
+	 * End the stream fed so far: the pending lexeme is split into tokens,
+	 * and the next chunk fed starts a new stream.
+	 * @param handler a callable taking a const Token&
+	 */
+	template<int... SkippedIds, typename Handler>
+	void finish(Handler&& handler);
+
+	/**
+	 * Take a checkpoint of the stream scan. It costs a copy of the pending
+	 * lexeme, which is usually a few bytes.
+	 * @throw std::logic_error when the scanner has no DFA
+	 */
+	Checkpoint checkpoint() const;
+
+	/**
+	 * Resume the stream scan of a checkpoint, the next chunk fed is the
+	 * one following its pending lexeme.
+	 * @param checkpoint a checkpoint of a scanner of the same rules
+	 * @throw std::invalid_argument when the checkpoint was taken with other
+	 *        rules, or does not match its pending lexeme
+	 * @throw std::logic_error when the scanner has no DFA
+	 */
+	void restore(const Checkpoint& checkpoint);
+
+private:
+	/**
+	 * Split the pending lexeme into the complete tokens.
+	 * @param pos the bytes of the pending lexeme already run through the DFA
+	 * @param last whether the stream ends with the pending lexeme
+	 */
+	template<int... SkippedIds, typename Handler>
+	void scan_pending(std::size_t pos, bool last, Handler& handler);
+
+
+	const DFA* _dfa;
+	const PositionAutomaton* _nfa;
+	int _start_condition;
+	int _start_state;
+
+	std::string _pending; /**< The bytes of the stream after the last complete token */
+	std::uint64_t _stream_offset; /**< The offset of _pending in the stream */
+	int _state; /**< The state of the DFA reached by _pending */
+	int _match_id; /**< The token of the longest match in _pending, -1 if none */
+	std::size_t _match_length; /**< The length of the longest match in _pending */
+};
+
+namespace detail
+{
+
+constexpr std::uint64_t token_mask()
+{ return 0; }
+
+template<typename... Ids>
+constexpr std::uint64_t token_mask(int id, Ids... ids)
+{ return std::uint64_t(1) << id | token_mask(ids...); }
+
+}
+
+inline bool Scanner::match(const std::string& input, std::size_t offset, Token& token) const
+{
+	if (_nfa) return _nfa->match(input, offset, _start_condition, token);
+
+	token = Token{-1, offset, 0};
+
+	auto state = _start_state;
+	for (auto i = offset; ; ++i)
+	{
+		if (_dfa->token_id(state) != -1)
+		{
+			token.token_id = _dfa->token_id(state);
+			token.length = i - offset;
+		}
+
+		if (i == input.length()) break;
+
+		state = _dfa->next(state, input[i]);
+		if (state == DFA::reject_state) break;
+	}
+
+	if (token.length == 0)
+	{
+		token.token_id = -1;
+		return false;
+	}
+	return true;
+}
+
+template<int... SkippedIds, typename Handler>
+void Scanner::scan(const std::string& input, Handler&& handler) const
+{
+	static_assert(detail::token_mask(SkippedIds...) == detail::token_mask(SkippedIds % 64 ...),
+	              "skipped token ids must be in [0, 64)");
+	constexpr auto skipped = detail::token_mask(SkippedIds...);
+
+	Token token;
+	for (std::size_t offset = 0; offset < input.length(); offset += token.length)
+	{
+		if (!match(input, offset, token))
+		{
+			token.length = 1;
+		}
+		else if (skipped != 0 && token.token_id < 64 && (skipped >> token.token_id & 1))
+		{
+			continue;
+		}
+		handler(static_cast<const Token&>(token));
+	}
+}
+
+template<int... SkippedIds, typename Handler>
+void Scanner::feed(const std::string& chunk, Handler&& handler)
+{
+	if (!_dfa) throw std::logic_error("stream scanning needs a DFA");
+
+	auto pos = _pending.length();
+	_pending += chunk;
+	scan_pending<SkippedIds...>(pos, false, handler);
+}
+
+template<int... SkippedIds, typename Handler>
+void Scanner::finish(Handler&& handler)
+{
+	if (!_dfa) throw std::logic_error("stream scanning needs a DFA");
+
+	scan_pending<SkippedIds...>(_pending.length(), true, handler);
+	_stream_offset = 0;
+}
+
+template<int... SkippedIds, typename Handler>
+void Scanner::scan_pending(std::size_t pos, bool last, Handler& handler)
+{
+	static_assert(detail::token_mask(SkippedIds...) == detail::token_mask(SkippedIds % 64 ...),
+	              "skipped token ids must be in [0, 64)");
+	constexpr auto skipped = detail::token_mask(SkippedIds...);
+
+	// The pending lexeme is only empty between tokens
+	if (pos == 0)
+	{
+		_state = _start_state;
+		_match_id = -1;
+		_match_length = 0;
+	}
+
+	// The token being matched starts at start
+	std::size_t start = 0;
+	while (start < _pending.length())
+	{
+		for (; pos < _pending.length(); ++pos)
+		{
+			auto state = _dfa->next(_state, _pending[pos]);
+			if (state == DFA::reject_state) break;
+
+			_state = state;
+			if (_dfa->token_id(state) != -1)
+			{
+				_match_id = _dfa->token_id(state);
+				_match_length = pos + 1 - start;
+			}
+		}
+
+		// Without the byte that ends it, the token may go on in the next chunk
+		if (pos == _pending.length() && !last) break;
+
+		Token token{_match_id, _stream_offset + start, _match_length};
+		if (token.length == 0)
+		{
+			token.length = 1;
+		}
+		start += token.length;
+
+		if (token.token_id == -1 || skipped == 0 || token.token_id >= 64 ||
+		    !(skipped >> token.token_id & 1))
+		{
+			handler(static_cast<const Token&>(token));
+		}
+
+		pos = start;
+		_state = _start_state;
+		_match_id = -1;
+		_match_length = 0;
+	}
+
+	_pending.erase(0, start);
+	_stream_offset += start;
+}
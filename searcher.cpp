@@ -0,0 +1,204 @@
+#include "searcher.h"
+
+#include <cstring>
+
+Searcher::Searcher(const DFA& dfa, int start_condition)
+	: _scanner(dfa), _dfa(&dfa), _start_state(dfa.start_state(start_condition)),
+	  _reverse_dfa(nullptr)
+{
+	_scanner.set_start_condition(start_condition);
+
+	auto state = dfa.start_state(start_condition);
+	for (int byte = 0; byte < 256; ++byte)
+	{
+		_start_bytes[byte] = dfa.next(state, byte) != DFA::reject_state;
+	}
+
+	// The prefix follows the states with a single transition, up to the
+	// first accepting state, as a match may end there
+	while (_prefix.length() < max_prefix_length && dfa.token_id(state) == -1)
+	{
+		int next_byte = -1;
+		for (int byte = 0; byte < 256; ++byte)
+		{
+			if (dfa.next(state, byte) == DFA::reject_state) continue;
+
+			next_byte = next_byte == -1 ? byte : 256;
+		}
+		if (next_byte == -1 || next_byte == 256) break;
+
+		_prefix += static_cast<char>(next_byte);
+		state = dfa.next(state, next_byte);
+	}
+}
+
+Searcher::Searcher(const DFA& dfa, const DFA& reverse_dfa)
+	: Searcher(dfa)
+{
+	_reverse_dfa = &reverse_dfa;
+}
+
+bool Searcher::find(const std::string& input, std::size_t offset, Token& token) const
+{
+	if (_reverse_dfa)
+	{
+		auto starts = cached_starts(input, offset);
+		for (; offset < input.length(); ++offset)
+		{
+			if ((*starts)[offset] && _scanner.match(input, offset, token)) return true;
+		}
+		return false;
+	}
+
+	for (offset = next_candidate(input, offset);
+	     offset < input.length();
+	     offset = next_candidate(input, offset + 1))
+	{
+		if (_scanner.match(input, offset, token)) return true;
+	}
+	return false;
+}
+
+std::vector<Token> Searcher::find_all(const std::string& input) const
+{
+	std::vector<Token> tokens;
+
+	Token token;
+	if (_reverse_dfa)
+	{
+		std::vector<bool> starts;
+		find_starts(input, 0, starts);
+
+		std::vector<int> states(input.length() + 1, DFA::reject_state);
+		std::vector<std::size_t> scans(input.length() + 1);
+		std::vector<Token> matches(input.length());
+		for (std::size_t offset = 0; offset < input.length();)
+		{
+			if (starts[offset] && match_start(input, offset, states, scans, matches))
+			{
+				tokens.emplace_back(matches[offset]);
+				offset += matches[offset].length;
+			}
+			else
+			{
+				++offset;
+			}
+		}
+		return tokens;
+	}
+
+	for (std::size_t offset = 0; find(input, offset, token); offset = token.offset + token.length)
+	{
+		tokens.emplace_back(token);
+	}
+	return tokens;
+}
+
+std::size_t Searcher::next_candidate(const std::string& input, std::size_t offset) const
+{
+	auto data = input.data();
+	auto length = input.length();
+
+	if (!_prefix.empty())
+	{
+		while (offset + _prefix.length() <= length)
+		{
+			auto found = static_cast<const char*>(
+				std::memchr(data + offset, _prefix[0], length - offset - _prefix.length() + 1));
+			if (found == nullptr) break;
+
+			offset = found - data;
+			if (std::memcmp(found + 1, _prefix.data() + 1, _prefix.length() - 1) == 0)
+				return offset;
+			++offset;
+		}
+		return length;
+	}
+
+	while (offset < length && !_start_bytes[static_cast<unsigned char>(data[offset])])
+	{
+		++offset;
+	}
+	return offset;
+}
+
+bool Searcher::match_start(const std::string& input,
+                           std::size_t offset,
+                           std::vector<int>& states,
+                           std::vector<std::size_t>& scans,
+                           std::vector<Token>& matches) const
+{
+	auto& token = matches[offset];
+	token = Token{-1, offset, 0};
+
+	auto state = _start_state;
+	for (auto i = offset; ; ++i)
+	{
+		// An earlier scan went on from here as this one would, its match
+		// ends here or later if this one ends after i
+		if (states[i] == state)
+		{
+			const auto& earlier = matches[scans[i]];
+			if (earlier.token_id != -1 && earlier.offset + earlier.length >= i)
+			{
+				token.token_id = earlier.token_id;
+				token.length = earlier.offset + earlier.length - offset;
+			}
+			break;
+		}
+		states[i] = state;
+		scans[i] = offset;
+
+		if (_dfa->token_id(state) != -1)
+		{
+			token.token_id = _dfa->token_id(state);
+			token.length = i - offset;
+		}
+
+		if (i == input.length()) break;
+
+		state = _dfa->next(state, input[i]);
+		if (state == DFA::reject_state) break;
+	}
+
+	if (token.length == 0)
+	{
+		token.token_id = -1;
+		return false;
+	}
+	return true;
+}
+
+void Searcher::find_starts(const std::string& input,
+                           std::size_t offset,
+                           std::vector<bool>& starts) const
+{
+	starts.assign(input.length(), false);
+
+	// The loop of the reversed rules matches any byte, so the scan does
+	// not stop before the offset
+	auto state = _reverse_dfa->start_state();
+	for (auto i = input.length(); i > offset && state != DFA::reject_state; --i)
+	{
+		state = _reverse_dfa->next(state, input[i - 1]);
+		starts[i - 1] = state != DFA::reject_state && _reverse_dfa->token_id(state) != -1;
+	}
+}
+
+std::shared_ptr<const std::vector<bool>> Searcher::cached_starts(const std::string& input,
+                                                                 std::size_t offset) const
+{
+	std::lock_guard<std::mutex> lock(_starts_mutex);
+	if (_starts && _starts_data == input.data() && _starts_length == input.length() &&
+	    _starts_offset <= offset)
+		return _starts;
+
+	auto starts = std::make_shared<std::vector<bool>>();
+	find_starts(input, offset, *starts);
+
+	_starts_data = input.data();
+	_starts_length = input.length();
+	_starts_offset = offset;
+	_starts = starts;
+	return starts;
+}
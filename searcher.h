@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <array>
+#include <memory>
+#include <mutex>
+
+#include "dfa.h"
+#include "scanner.h"
+#include "token.h"
+
+/**
+ * A class for finding the matches of the rules anywhere in an input. The
+ * DFA is only run from the offsets where a match can start: the offsets
+ * of the literal prefix all the matches share, found with memchr, or
+ * else the offsets of the bytes leading out of the start state.
+ *
+ * With a reverse DFA, the offsets where a match starts are found instead
+ * by a single backward scan of the input, so that no candidate fails
+ * after a long partial match. find_all() runs the forward scans of the
+ * matches from these offsets, a scan stopping where an earlier one went
+ * through the same state at the same offset: it would go on as that scan
+ * did, so it takes its match. A search such as a|a*b over a run of a is
+ * then linear, but rules whose scans from successive starts keep in
+ * different states can still take quadratic time. find() keeps the
+ * offsets found for the last input it searched, so the successive calls
+ * on an input scan it backwards only once.
+ */
+class Searcher
+{
+public:
+	/**
+	 * The maximum length of the literal prefix.
+	 */
+	static constexpr std::size_t max_prefix_length = 64;
+
+
+	/**
+	 * @param dfa the automaton of the rules, it must outlive the searcher
+	 * @param start_condition the index of the start condition to search with
+	 */
+	explicit Searcher(const DFA& dfa, int start_condition = 0);
+
+	/**
+	 * @param dfa the automaton of the rules, it must outlive the searcher
+	 * @param reverse_dfa the automaton of tree.reversed(true), where tree is
+	 *                    the tree of dfa, it must outlive the searcher
+	 */
+	Searcher(const DFA& dfa, const DFA& reverse_dfa);
+
+	/**
+	 * Find the leftmost non empty match, the longest one at its offset. It
+	 * can be called from several threads.
+	 * @param input the input, with a reverse DFA it must not change
+	 *              between two calls on it, as it is told apart from the
+	 *              last input searched by its address and length
+	 * @param offset the offset to search from
+	 * @param token the match found
+	 * @return true when a match is found
+	 */
+	bool find(const std::string& input, std::size_t offset, Token& token) const;
+
+	/**
+	 * Find the successive non overlapping matches of an input.
+	 * @param input the input
+	 * @return the matches in order
+	 */
+	std::vector<Token> find_all(const std::string& input) const;
+
+	/**
+	 * The literal every match starts with, possibly empty.
+	 */
+	const std::string& prefix() const
+	{ return _prefix; }
+
+private:
+	/**
+	 * The first offset from a given one where a match may start.
+	 * @return the offset, or the length of the input if there is none
+	 */
+	std::size_t next_candidate(const std::string& input, std::size_t offset) const;
+
+	/**
+	 * Scan an input backwards with the reverse DFA, down to a given offset.
+	 * @param starts set for the offsets where a match may start
+	 */
+	void find_starts(const std::string& input,
+	                 std::size_t offset,
+	                 std::vector<bool>& starts) const;
+
+	/**
+	 * The offsets where a match may start in an input, down to a given
+	 * offset, found by find_starts() unless they are kept from the last
+	 * call on the same input.
+	 */
+	std::shared_ptr<const std::vector<bool>> cached_starts(const std::string& input,
+	                                                       std::size_t offset) const;
+
+	/**
+	 * Match the longest token at a start found by find_starts(), as
+	 * Scanner::match() does, for the successive starts of find_all().
+	 * @param states the state of the last scan through each offset
+	 * @param scans the start of the last scan through each offset
+	 * @param matches the match of the scan from each start
+	 * @return true when a non empty token is matched, in matches[offset]
+	 */
+	bool match_start(const std::string& input,
+	                 std::size_t offset,
+	                 std::vector<int>& states,
+	                 std::vector<std::size_t>& scans,
+	                 std::vector<Token>& matches) const;
+
+
+	Scanner _scanner;
+	const DFA* _dfa;
+	int _start_state;
+	const DFA* _reverse_dfa;
+	std::string _prefix; /**< The literal prefix of all the matches */
+	std::array<bool, 256> _start_bytes; /**< The bytes a match can start with */
+
+	mutable std::mutex _starts_mutex; /**< Guards the starts kept by find() */
+	mutable const char* _starts_data = nullptr; /**< The data of the input of the starts */
+	mutable std::size_t _starts_length = 0; /**< The length of the input of the starts */
+	mutable std::size_t _starts_offset = 0; /**< The offset the starts were found down to */
+	mutable std::shared_ptr<const std::vector<bool>> _starts;
+};
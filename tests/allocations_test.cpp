@@ -0,0 +1,79 @@
+#include "regex.h"
+#include "regex_tree.h"
+#include "dfa.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "check.h"
+
+/*
+ * The allocations of the construction from a regex to a DFA, counted by
+ * replacing the global operator new. The position sets take a few
+ * allocations in all, but the tree still makes about 4 allocations per
+ * position: each node is allocated on its own, and the bracket classes are
+ * split into byte sequences held in temporary vectors. The subset
+ * construction makes about 2.
+ */
+
+namespace
+{
+
+std::size_t allocations = 0;
+
+}
+
+void* operator new(std::size_t size)
+{
+	++allocations;
+	if (auto pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{ std::free(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept
+{ std::free(pointer); }
+
+namespace
+{
+
+void test_construction_allocations()
+{
+	AugmentedRegex regex(
+		"[a-zA-Z_][a-zA-Z_0-9]*)#|([0-9]+(\\.[0-9]+)?([eE][+-]?[0-9]+)?)#|"
+		"(\"([^\"\\\\]|\\\\.)*\")#|(if)#|(else)#|(while)#|(for)#|(return)#|"
+		"((ab|cd){3,6})#|([ \\t\\n]+");
+
+	auto before_tree = allocations;
+	AugmentedRegexTree tree(regex);
+	auto tree_allocations = allocations - before_tree;
+
+	auto before_dfa = allocations;
+	DFA dfa(tree);
+	auto dfa_allocations = allocations - before_dfa;
+
+	auto positions = tree.positions_count();
+	std::cout << positions << " positions\n"
+	          << "tree: " << tree_allocations << " allocations, "
+	          << static_cast<double>(tree_allocations) / positions << " per position\n"
+	          << "dfa: " << dfa_allocations << " allocations, "
+	          << static_cast<double>(dfa_allocations) / positions << " per position\n";
+
+	// Before the sets of positions were sorted vectors, the tree made 18.8
+	// allocations per position and the DFA 174.8. Before they were pooled,
+	// the tree made 10.1.
+	CHECK(tree_allocations <= 5 * positions);
+	CHECK(dfa_allocations <= 3 * positions);
+}
+
+}
+
+int main()
+{
+	test_construction_allocations();
+
+	return check_result();
+}
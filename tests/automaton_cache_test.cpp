@@ -0,0 +1,162 @@
+#include "automaton_cache.h"
+#include "scanner.h"
+#include "dfa.h"
+#include "regex.h"
+#include "regex_tree.h"
+
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * The DFA of rules built at once, the token id of a rule being its index.
+ */
+DFA built_dfa(const std::vector<std::string>& rules)
+{
+	std::string regex;
+	for (const auto& rule : rules)
+	{
+		if (!regex.empty()) regex += ")#|(";
+		regex += rule;
+	}
+	DFA dfa{AugmentedRegexTree(AugmentedRegex(regex))};
+	dfa.minimize();
+	return dfa;
+}
+
+/**
+ * Whether two DFAs split an input into the same tokens.
+ */
+bool same_tokenization(const DFA& first, const DFA& second, const std::string& input)
+{
+	return Scanner(first).tokenize(input) == Scanner(second).tokenize(input);
+}
+
+/**
+ * The rules of a language: keywords first, then the general rules.
+ */
+std::vector<std::string> base_rules()
+{
+	std::vector<std::string> rules;
+	for (int i = 0; i < 40; ++i) rules.emplace_back("kw" + std::to_string(i * 7919 % 1000) + "[a-c]?");
+	rules.emplace_back("[a-z_][a-z0-9_]*");
+	rules.emplace_back("[0-9]+(\\.[0-9]+)?");
+	rules.emplace_back("[ \\t\\n]+");
+	rules.emplace_back("\"([^\"\\\\]|\\\\.)*\"");
+	return rules;
+}
+
+std::string source_text(const std::vector<std::string>& rules)
+{
+	std::mt19937 random(1);
+	std::string text;
+	for (int i = 0; i < 3000; ++i)
+	{
+		text += i % 3 ? rules[random() % 40].substr(0, 6) : "x1 ";
+		text += ' ';
+		if (i % 50 == 0) text += "\"s\\\"t\" 3.25 dialect_x @ab $ tenant42 ";
+	}
+	return text;
+}
+
+void test_dialects()
+{
+	auto base = base_rules();
+	auto dialect = base;
+	dialect.insert(dialect.begin() + 42, "dialect_[a-z]+");
+	dialect.emplace_back("@[a-z]+");
+	dialect.emplace_back("\\$");
+	auto tenant = base;
+	tenant.emplace_back("tenant[0-9]+");
+
+	const auto input = source_text(base);
+
+	AutomatonCache cache;
+	CHECK(cache.dfa({}) == nullptr);
+
+	auto base_dfa = cache.dfa(base);
+	auto dialect_dfa = cache.dfa(dialect);
+	auto tenant_dfa = cache.dfa(tenant);
+	CHECK(same_tokenization(*base_dfa, built_dfa(base), input));
+	CHECK(same_tokenization(*dialect_dfa, built_dfa(dialect), input));
+	CHECK(same_tokenization(*tenant_dfa, built_dfa(tenant), input));
+
+	// A rule set already seen is found without building anything
+	auto size = cache.size();
+	CHECK(cache.dfa(base) == base_dfa);
+	CHECK(cache.size() == size);
+
+	// The rules are keyed as parsed
+	CHECK(cache.rule_dfa("\\a\\b") == cache.rule_dfa("ab"));
+	CHECK(cache.rule_dfa("a\\*") != cache.rule_dfa("a*"));
+	CHECK(cache.rule_dfa("[a-c]") != cache.rule_dfa("a-c"));
+}
+
+void test_memory_budget()
+{
+	auto base = base_rules();
+	auto dialect = base;
+	dialect.emplace_back("@[a-z]+");
+	const auto input = source_text(base);
+
+	AutomatonCache unbounded;
+	unbounded.dfa(base);
+	CHECK(unbounded.memory_bytes() > 200000);
+
+	AutomatonCache cache(200000);
+	auto base_dfa = cache.dfa(base);
+	CHECK(cache.memory_bytes() <= 200000);
+	CHECK(cache.size() < unbounded.size());
+
+	// The automata dropped from the cache are rebuilt when needed again
+	auto dialect_dfa = cache.dfa(dialect);
+	CHECK(cache.memory_bytes() <= 200000);
+	CHECK(same_tokenization(*base_dfa, built_dfa(base), input));
+	CHECK(same_tokenization(*dialect_dfa, built_dfa(dialect), input));
+	CHECK(same_tokenization(*cache.dfa(base), *base_dfa, input));
+}
+
+void test_threads()
+{
+	auto base = base_rules();
+	auto dialect = base;
+	dialect.insert(dialect.begin() + 10, "dialect_[a-z]+");
+	const auto input = source_text(base);
+
+	AutomatonCache cache(1000000);
+	std::vector<std::shared_ptr<const DFA>> dfas(4);
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < dfas.size(); ++i)
+	{
+		threads.emplace_back([&cache, &dfas, &base, &dialect, i]
+		{
+			dfas[i] = cache.dfa(i % 2 ? base : dialect);
+		});
+	}
+	for (auto& thread : threads) thread.join();
+
+	auto dialect_dfa = built_dfa(dialect);
+	auto base_dfa = built_dfa(base);
+	for (std::size_t i = 0; i < dfas.size(); ++i)
+	{
+		CHECK(same_tokenization(*dfas[i], i % 2 ? base_dfa : dialect_dfa, input));
+	}
+}
+
+}
+
+int main()
+{
+	test_dialects();
+	test_memory_budget();
+	test_threads();
+
+	return check_result();
+}
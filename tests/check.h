@@ -0,0 +1,42 @@
+#pragma once
+
+#include <iostream>
+
+/**
+ * The number of failed checks of the test.
+ */
+inline int& check_failures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+/**
+ * Report a failed check and count it.
+ */
+inline void check_failed(const char* file, int line, const char* condition)
+{
+	std::cerr << file << ':' << line << ": check failed: " << condition << '\n';
+	++check_failures();
+}
+
+#define CHECK(condition) \
+	((condition) ? (void)0 : check_failed(__FILE__, __LINE__, #condition))
+
+#define CHECK_THROWS(expression, exception) \
+	do \
+	{ \
+		bool thrown = false; \
+		try { (void)(expression); } \
+		catch (const exception&) { thrown = true; } \
+		catch (...) { } \
+		if (!thrown) check_failed(__FILE__, __LINE__, #expression " throws " #exception); \
+	} while (false)
+
+/**
+ * The exit status of the test.
+ */
+inline int check_result()
+{
+	return check_failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+# Run the lexer with -o on a path going up from the working directory, and
+# check that the token streams are written under the output directory
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR}/output)
+
+execute_process(
+	COMMAND ${LEXER} -j 2 -o ${WORK_DIR}/output ${DATA_DIR}/rules.txt ../data/sources
+	WORKING_DIRECTORY ${DATA_DIR}
+	RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "the lexer failed: ${result}")
+endif()
+
+if(EXISTS ${WORK_DIR}/data)
+	message(FATAL_ERROR "a token stream was written outside the output directory")
+endif()
+
+# "TOK1", then the id + 1 and the length of each token of "foo 12 bar\n"
+file(READ ${WORK_DIR}/output/data/sources/a.txt.tok stream HEX)
+if(NOT stream STREQUAL "544f4b31010303010202030101030301")
+	message(FATAL_ERROR "unexpected token stream ${stream}")
+endif()
+
+if(NOT EXISTS ${WORK_DIR}/output/data/sources/nested/b.txt.tok)
+	message(FATAL_ERROR "the file of the nested directory was not lexed")
+endif()
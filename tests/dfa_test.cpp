@@ -0,0 +1,255 @@
+#include "dfa.h"
+#include "regex.h"
+#include "regex_tree.h"
+
+#include <algorithm>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * Whether two DFAs have the same states, numbered the same way.
+ */
+bool same_table(const DFA& first, const DFA& second)
+{
+	if (first.states_count() != second.states_count() ||
+	    first.start_conditions_count() != second.start_conditions_count())
+		return false;
+
+	for (int i = 0; i < first.start_conditions_count(); ++i)
+	{
+		if (first.start_state(i) != second.start_state(i)) return false;
+	}
+	for (int state = 0; state < first.states_count(); ++state)
+	{
+		if (first.token_id(state) != second.token_id(state)) return false;
+		for (int byte = 0; byte < 256; ++byte)
+		{
+			if (first.next(state, byte) != second.next(state, byte)) return false;
+		}
+	}
+	return first.fingerprint() == second.fingerprint();
+}
+
+void test_parallel_construction()
+{
+	AugmentedRegexTree tree(AugmentedRegex(
+		"(a|b)*a(a|b){8})#|([a-z_][a-z0-9_]{0,12})#|([0-9]+(\\.[0-9]+)?"));
+
+	DFA serial(tree);
+	CHECK(serial.states_count() > 256);
+
+	for (unsigned int threads : {1u, 2u, 4u, 8u})
+	{
+		DFA parallel(tree, threads);
+		CHECK(same_table(parallel, serial));
+
+		DFA minimized(tree, threads);
+		minimized.minimize();
+		DFA serial_minimized(tree);
+		serial_minimized.minimize();
+		CHECK(same_table(minimized, serial_minimized));
+	}
+}
+
+void test_parallel_start_conditions()
+{
+	AugmentedRegexTree tree(AugmentedRegex("[a-z]+)#|([0-9]+)#|(\"[^\"]*\""));
+	std::vector<std::vector<int>> start_conditions{{0, 1}, {2}, {0, 2}};
+
+	DFA serial(tree, start_conditions);
+	for (unsigned int threads : {2u, 4u})
+	{
+		CHECK(same_table(DFA(tree, start_conditions, threads), serial));
+	}
+}
+
+void test_budget()
+{
+	// (a|b)*a(a|b){n} has 2^(n+1) states
+	std::string exponential = "(a|b)*a";
+	for (int i = 0; i < 20; ++i) exponential += "(a|b)";
+	AugmentedRegexTree tree(AugmentedRegex(exponential + ")#|(c+"));
+
+	for (unsigned int threads : {1u, 4u})
+	{
+		CHECK_THROWS(DFA(tree, threads, DFA::Budget(10000)), DFA::BudgetExceeded);
+		CHECK_THROWS(DFA(tree, threads, DFA::Budget(DFA::Budget().max_states, 1 << 20)),
+		             DFA::BudgetExceeded);
+	}
+
+	// A budget large enough changes nothing
+	AugmentedRegexTree small(AugmentedRegex("(a|b)*a(a|b))#|(c+"));
+	CHECK(same_table(DFA(small, 2, DFA::Budget(100, 1 << 20)), DFA(small)));
+}
+
+void test_matches()
+{
+	// More than 64 rules, so the accepted rules of a state take several
+	// words
+	const std::vector<std::string> patterns = {
+		"[a-z]+", "error[a-z ]*", "[a-z]*or", "a{2,3}b?", "(ab|cd)*", "x", "[0-9]+", "err(or)?"};
+	const int rules_count = 70;
+
+	std::string rules;
+	for (int i = 0; i < rules_count; ++i)
+	{
+		if (i != 0) rules += ")#|(";
+		rules += patterns[i % patterns.size()];
+	}
+	AugmentedRegexTree tree{AugmentedRegex(rules)};
+	CHECK(tree.rules_count() == rules_count);
+
+	for (unsigned int threads : {1u, 3u})
+	{
+		for (bool minimized : {false, true})
+		{
+			DFA dfa(tree, threads);
+			if (minimized) dfa.minimize();
+
+			for (const std::string input : {"", "error", "err", "aa", "aab", "abcd", "x",
+			                                "123", "or", "erroror", "error x", "zzz"})
+			{
+				std::vector<int> expected;
+				for (int i = 0; i < rules_count; ++i)
+				{
+					if (std::regex_match(input, std::regex(patterns[i % patterns.size()])))
+						expected.push_back(i);
+				}
+				CHECK(dfa.matches(input) == expected);
+			}
+
+			// The winning rule is the first of the accepted ones
+			int state = dfa.start_state();
+			for (char c : std::string("err")) state = dfa.next(state, c);
+			CHECK(dfa.token_id(state) == 0);
+			CHECK(dfa.accepts(state, 0) && dfa.accepts(state, 7) && dfa.accepts(state, 64));
+			CHECK(!dfa.accepts(state, 2) && !dfa.accepts(state, 6));
+		}
+	}
+}
+
+void test_transitions()
+{
+	DFA dfa{AugmentedRegexTree(AugmentedRegex("[a-z_][a-z0-9_]*)#|([0-9]+)#|(if)#|( "))};
+	dfa.minimize();
+	const auto& alphabet = dfa.alphabet();
+
+	bool same = true;
+	for (int state = 0; state < dfa.states_count(); ++state)
+	{
+		// The rows are sorted by symbol and agree with the table
+		int previous = -1;
+		for (auto trans = dfa.transitions_begin(state); trans != dfa.transitions_end(state); ++trans)
+		{
+			same = same && trans->symbol > previous;
+			previous = trans->symbol;
+		}
+
+		for (std::size_t i = 0; i < alphabet.size(); ++i)
+		{
+			auto next = dfa.symbol_transition(state, i);
+			same = same && dfa.transition(state, alphabet[i]) == next;
+			for (int byte = alphabet[i].first(); byte <= alphabet[i].last(); ++byte)
+			{
+				same = same && dfa.next(state, byte) == next;
+			}
+		}
+	}
+	CHECK(same);
+
+	// Symbols that are not in the alphabet, even if they match its bytes
+	int state = dfa.start_state();
+	CHECK(dfa.transition(state, Regex::Symbol("i")) != -1);
+	CHECK(dfa.transition(state, Regex::Symbol("!")) == -1);
+	CHECK(dfa.transition(state, Regex::Symbol("a-z")) == -1);
+	CHECK(dfa.transition(state, Regex::Symbol("[a-z]")) == -1);
+}
+
+/**
+ * Whether every state of a DFA but the given ones reaches an accepting
+ * state.
+ */
+bool all_live(const DFA& dfa, const std::vector<int>& dead_states)
+{
+	std::vector<bool> live(dfa.states_count());
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		for (int state = 0; state < dfa.states_count(); ++state)
+		{
+			if (live[state]) continue;
+
+			live[state] = dfa.token_id(state) != -1;
+			for (int byte = 0; byte < 256 && !live[state]; ++byte)
+			{
+				auto next = dfa.next(state, byte);
+				live[state] = next != DFA::reject_state && live[next];
+			}
+			changed = changed || live[state];
+		}
+	}
+
+	for (int state = 0; state < dfa.states_count(); ++state)
+	{
+		bool dead = std::find(dead_states.cbegin(), dead_states.cend(), state) != dead_states.cend();
+		if (live[state] == dead) return false;
+	}
+	return true;
+}
+
+void test_minimize()
+{
+	// The classic example: four states, none of them a sink
+	DFA abb{AugmentedRegexTree(AugmentedRegex("(a|b)*abb"))};
+	abb.minimize();
+	CHECK(abb.states_count() == 4);
+	CHECK(all_live(abb, {}));
+
+	// A doomed lexeme goes to reject_state right away
+	int state = abb.start_state();
+	for (char c : std::string("ab")) state = abb.next(state, c);
+	CHECK(state != DFA::reject_state);
+	CHECK(abb.next(state, 'c') == DFA::reject_state);
+
+	// A start condition without rules keeps its start state, which has no
+	// transitions
+	AugmentedRegexTree tree(AugmentedRegex("[a-z]+)#|([0-9]+)#|(if"));
+	DFA dfa(tree, {{0, 1, 2}, {}, {1}});
+	DFA minimized(tree, {{0, 1, 2}, {}, {1}});
+	minimized.minimize();
+	CHECK(minimized.states_count() <= dfa.states_count());
+	CHECK(all_live(minimized, {minimized.start_state(1)}));
+	for (int byte = 0; byte < 256; ++byte)
+	{
+		CHECK(minimized.next(minimized.start_state(1), byte) == DFA::reject_state);
+	}
+
+	// The same rules are matched
+	for (const std::string input : {"", "if", "iff", "12", "a1", "zz", "9"})
+	{
+		for (int start_condition = 0; start_condition < 3; ++start_condition)
+		{
+			CHECK(minimized.matches(input, start_condition) == dfa.matches(input, start_condition));
+		}
+	}
+}
+
+}
+
+int main()
+{
+	test_parallel_construction();
+	test_parallel_start_conditions();
+	test_budget();
+	test_matches();
+	test_transitions();
+	test_minimize();
+
+	return check_result();
+}
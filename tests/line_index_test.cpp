@@ -0,0 +1,79 @@
+#include "line_index.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * The position of an offset, counted byte by byte.
+ */
+TextPosition counted_position(const std::string& input, std::size_t offset)
+{
+	TextPosition position{1, 1};
+	for (std::size_t i = 0; i < offset; ++i)
+	{
+		if (input[i] == '\n') position = TextPosition{position.line + 1, 1};
+		else ++position.column;
+	}
+	return position;
+}
+
+void test_positions()
+{
+	for (const std::string input : {"", "\n", "ab\n\ncd\nefg", "ab\n", "\n\nx"})
+	{
+		LineIndex index(input);
+		bool same = true;
+		for (std::size_t offset = 0; offset <= input.length(); ++offset)
+		{
+			auto position = index.position(offset);
+			auto expected = counted_position(input, offset);
+			same = same && position.line == expected.line && position.column == expected.column;
+		}
+		CHECK(same);
+	}
+
+	CHECK(LineIndex("").lines_count() == 1);
+	CHECK(LineIndex("ab\n\ncd\nefg").lines_count() == 4);
+	CHECK(LineIndex("ab\n").lines_count() == 2);
+}
+
+void test_concurrent_queries()
+{
+	std::string input;
+	for (int i = 0; i < 100000; ++i) input += i % 40 == 0 ? '\n' : 'x';
+	LineIndex index(input);
+
+	// The first queries race to build the index
+	std::vector<TextPosition> positions(4);
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < positions.size(); ++i)
+	{
+		threads.emplace_back([&index, &positions, &input, i]
+		{
+			positions[i] = index.position(input.length() - i);
+		});
+	}
+	for (auto& thread : threads) thread.join();
+
+	for (std::size_t i = 0; i < positions.size(); ++i)
+	{
+		auto expected = counted_position(input, input.length() - i);
+		CHECK(positions[i].line == expected.line && positions[i].column == expected.column);
+	}
+}
+
+}
+
+int main()
+{
+	test_positions();
+	test_concurrent_queries();
+
+	return check_result();
+}
@@ -0,0 +1,73 @@
+#include "position_automaton.h"
+#include "scanner.h"
+#include "dfa.h"
+#include "regex.h"
+#include "regex_tree.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+namespace
+{
+
+void test_same_tokens_as_dfa()
+{
+	AugmentedRegexTree tree(AugmentedRegex("[a-z]+)#|([0-9]+(\\.[0-9]+)?)#|(if)#|(a{2,4}b)#|( "));
+	const std::vector<std::vector<int>> start_conditions{{0, 1, 2, 3, 4}, {1, 4}};
+
+	DFA dfa(tree, start_conditions);
+	dfa.minimize();
+	PositionAutomaton nfa(tree, start_conditions);
+	CHECK(nfa.start_conditions_count() == 2);
+
+	std::mt19937 random(1);
+	const std::string alphabet = "aif09.b z";
+	std::string input;
+	for (int i = 0; i < 20000; ++i) input += alphabet[random() % alphabet.length()];
+
+	Scanner dfa_scanner(dfa);
+	Scanner nfa_scanner(nfa);
+	for (int start_condition = 0; start_condition < 2; ++start_condition)
+	{
+		dfa_scanner.set_start_condition(start_condition);
+		nfa_scanner.set_start_condition(start_condition);
+
+		auto tokens = dfa_scanner.tokenize(input);
+		CHECK(nfa_scanner.tokenize(input) == tokens);
+
+		auto batch = nfa_scanner.tokenize_batch({input, "", input});
+		CHECK(batch.size() == 3 && batch[1].empty() && batch[2] == tokens);
+	}
+}
+
+void test_over_budget_rules()
+{
+	// Rules whose DFA would have 2^22 states
+	std::string exponential = "(a|b)*a";
+	for (int i = 0; i < 20; ++i) exponential += "(a|b)";
+	AugmentedRegexTree tree(AugmentedRegex(exponential + ")#|(c+"));
+	CHECK_THROWS(DFA(tree, 1, DFA::Budget(10000)), DFA::BudgetExceeded);
+
+	PositionAutomaton nfa(tree);
+	Scanner scanner(nfa);
+
+	const std::string tail(20, 'b');
+	auto tokens = scanner.tokenize("a" + tail + "cccx");
+	CHECK(tokens.size() == 3);
+	CHECK(tokens[0].token_id == 0 && tokens[0].length == 1 + tail.length());
+	CHECK(tokens[1].token_id == 1 && tokens[1].length == 3);
+	CHECK(tokens[2].token_id == -1 && tokens[2].length == 1);
+}
+
+}
+
+int main()
+{
+	test_same_tokens_as_dfa();
+	test_over_budget_rules();
+
+	return check_result();
+}
@@ -0,0 +1,152 @@
+#include "regex.h"
+#include "regex_tree.h"
+#include "dfa.h"
+
+#include <regex>
+#include <stdexcept>
+#include <string>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * Whether a DFA accepts a whole string.
+ */
+bool accepts(const DFA& dfa, const std::string& str)
+{
+	int state = dfa.start_state();
+	for (char c : str)
+	{
+		state = dfa.next(state, static_cast<unsigned char>(c));
+		if (state == DFA::reject_state) return false;
+	}
+	return dfa.token_id(state) != -1;
+}
+
+void test_symbols()
+{
+	Regex regex("a{2,3}[a-c]b-d{-}\\##x{,");
+	const auto& symbols = regex.symbols();
+
+	CHECK(symbols.size() == 10);
+	CHECK(symbols[0].is_char());
+	CHECK(symbols[1].is_repeat() && symbols[1].repeat_bounds() == std::make_pair(2, 3));
+	CHECK(symbols[2].is_class());
+	CHECK(symbols[3].is_range() && symbols[3].first() == 'b' && symbols[3].last() == 'd');
+	// A brace not starting a repeat operator is an ordinary symbol
+	CHECK(symbols[4].is_range() && symbols[4].first() == '{' && symbols[4].last() == '}');
+	CHECK(symbols[5].is_char() && symbols[5].first() == '#');
+	CHECK(symbols[6].is_end_marker());
+	CHECK(symbols[7].is_char() && symbols[8].is_char() && symbols[9].is_char());
+
+	CHECK(Regex::Symbol("{5,}").repeat_bounds() == std::make_pair(5, -1));
+	CHECK(Regex::Symbol("+").repeat_bounds() == std::make_pair(1, -1));
+	CHECK(Regex::Symbol("?").repeat_bounds() == std::make_pair(0, 1));
+}
+
+void test_errors()
+{
+	CHECK_THROWS(Regex("[abc"), std::invalid_argument);
+	CHECK_THROWS(Regex("[c-a]"), std::invalid_argument);
+	CHECK_THROWS(Regex(std::string("[^\0-\xF4\x8F\xBF\xBF]", 9)), std::invalid_argument);
+	CHECK_THROWS(Regex("a{3,2}"), std::invalid_argument);
+	CHECK_THROWS(Regex::Symbol("a").repeat_bounds(), std::invalid_argument);
+	CHECK_THROWS(Regex::Symbol("a").code_point_ranges(), std::invalid_argument);
+	CHECK_THROWS(Regex::Symbol("\xCE\xB1-\xCE\xB1x"), std::invalid_argument);
+
+	// Surrogates and overlong encodings are not valid UTF-8
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex("\xED\xA0\x80")), std::invalid_argument);
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex("[\xED\xA0\x80-\xED\xBF\xBF]")),
+	             std::invalid_argument);
+	CHECK_THROWS(Regex("\xE0\x80\x80"), std::invalid_argument);
+	CHECK_THROWS(Regex("a-\xF0\x80\x80\x80"), std::invalid_argument);
+	// A class matching only surrogates has nothing to match
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex(std::string(
+		"[^\0-\xED\x9F\xBF\xEE\x80\x80-\xF4\x8F\xBF\xBF]", 16))), std::invalid_argument);
+
+	// The counts overflowing an int are over the limit too
+	CHECK_THROWS(Regex("x{99999999999}"), std::length_error);
+	CHECK_THROWS(Regex("x{1,99999999999}"), std::length_error);
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex("a{1001}")), std::length_error);
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex("((a{1000}){1000}){1000}")), std::length_error);
+
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex("a))(b")), std::invalid_argument);
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex("(a")), std::invalid_argument);
+	CHECK_THROWS(AugmentedRegexTree(AugmentedRegex("a||b")), std::invalid_argument);
+
+	// Operators used as operands
+	for (const char* regex : {"*a", "+a", "{2}a", "(|)", "a|+", "?", "a(*)", "(+)b"})
+	{
+		CHECK_THROWS(AugmentedRegexTree(AugmentedRegex(regex)), std::invalid_argument);
+	}
+}
+
+void test_matches()
+{
+	struct Case
+	{
+		const char* regex;
+		const char* ecmascript; /**< The same language for std::regex */
+	};
+
+	const Case cases[] = {
+		{"a+", "a+"},
+		{"a?b", "a?b"},
+		{"(ab){2,3}", "(ab){2,3}"},
+		{"a{3}", "a{3}"},
+		{"a{2,}", "a{2,}"},
+		{"(a|b){1,4}c", "(a|b){1,4}c"},
+		{"(a*){2,3}", "(a*){2,3}"},
+		{"((ab){1,2}c){2}", "((ab){1,2}c){2}"},
+		{"(a?){2,4}b", "(a?){2,4}b"},
+		{"[a-c]+", "[a-c]+"},
+		{"[^a]b", "[^a]b"},
+		{"[ab\\]]*", "[ab\\]]*"},
+		{"x{0}y", "y"},
+		{"\\+\\*", "\\+\\*"},
+		{"a{,", "a\\{,"},
+		{"{-}", "[{-}]"},
+		{"a(b|c)?{2}", "a((b|c)?){2}"},
+		{"[a-]b", "[a-]b"},
+		{"(ab|a){2,3}b?", "(ab|a){2,3}b?"},
+	};
+
+	// Every string of up to 4 characters over an alphabet covering the cases
+	const std::string alphabet = "abc]+*{,y-}";
+	for (const auto& test_case : cases)
+	{
+		std::regex expected(test_case.ecmascript);
+		DFA dfa{AugmentedRegexTree(AugmentedRegex(test_case.regex))};
+
+		bool same = true;
+		std::string str;
+		std::vector<std::size_t> digits;
+		while (same && digits.size() <= 4)
+		{
+			str.clear();
+			for (auto digit : digits) str += alphabet[digit];
+			same = accepts(dfa, str) == std::regex_match(str, expected);
+
+			// The next string
+			std::size_t i = 0;
+			for (; i < digits.size() && digits[i] + 1 == alphabet.length(); ++i) digits[i] = 0;
+			if (i == digits.size()) digits.push_back(0);
+			else ++digits[i];
+		}
+		if (!same) std::cerr << test_case.regex << " on \"" << str << "\"\n";
+		CHECK(same);
+	}
+}
+
+}
+
+int main()
+{
+	test_symbols();
+	test_errors();
+	test_matches();
+
+	return check_result();
+}
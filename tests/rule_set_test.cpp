@@ -0,0 +1,133 @@
+#include "rule_set.h"
+#include "scanner.h"
+#include "dfa.h"
+#include "regex.h"
+#include "regex_tree.h"
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * Random source text made of keywords, identifiers, numbers and strings.
+ */
+std::string source_text()
+{
+	std::mt19937 random(5);
+	std::string text;
+	for (int i = 0; i < 5000; ++i)
+	{
+		switch (random() % 6)
+		{
+			case 0: text += "kw" + std::to_string(random() % 30); break;
+			case 1: text += "x1_y"; break;
+			case 2: text += "3.14"; break;
+			case 3: text += "\"s t\""; break;
+			case 4: text += "zzz"; break;
+			default: text += "9";
+		}
+		text += ' ';
+	}
+	return text;
+}
+
+/**
+ * Whether the DFA of a rule set gives the tokens of a DFA built from its
+ * rules at once.
+ * @param live the ids of the rules in the set, in increasing order
+ */
+bool same_as_built(const RuleSet& rule_set,
+                   const std::vector<std::string>& rules,
+                   const std::vector<int>& live,
+                   const std::string& input)
+{
+	std::string regex;
+	for (auto id : live)
+	{
+		if (!regex.empty()) regex += ")#|(";
+		regex += rules[id];
+	}
+	DFA built{AugmentedRegexTree(AugmentedRegex(regex))};
+
+	auto tokens = Scanner(*rule_set.dfa()).tokenize(input);
+	auto expected = Scanner(built).tokenize(input);
+	if (tokens.size() != expected.size()) return false;
+	for (std::size_t i = 0; i < tokens.size(); ++i)
+	{
+		// The tokens of the built DFA are numbered among the live rules
+		auto token_id = expected[i].token_id == -1 ? -1 : live[expected[i].token_id];
+		if (tokens[i].token_id != token_id ||
+		    tokens[i].offset != expected[i].offset ||
+		    tokens[i].length != expected[i].length)
+			return false;
+	}
+	return true;
+}
+
+void test_changes()
+{
+	std::vector<std::string> rules;
+	for (int i = 0; i < 20; ++i) rules.emplace_back("kw" + std::to_string(i));
+	rules.emplace_back("[a-z_][a-z0-9_]*");
+	rules.emplace_back("[0-9]+(\\.[0-9]+)?");
+	rules.emplace_back("[ \\n]+");
+	rules.emplace_back("\"[^\"]*\"");
+
+	const auto input = source_text();
+
+	RuleSet rule_set;
+	CHECK(rule_set.dfa() == nullptr);
+
+	// A thread scanning with the DFA while the rules change
+	std::atomic<bool> stop(false);
+	std::thread reader([&rule_set, &input, &stop]
+	{
+		while (!stop)
+		{
+			auto dfa = rule_set.dfa();
+			if (dfa) Scanner(*dfa).tokenize(input.substr(0, 1000));
+		}
+	});
+
+	std::vector<int> live;
+	for (std::size_t i = 0; i < rules.size(); ++i)
+	{
+		live.push_back(rule_set.add_rule(rules[i]));
+		CHECK(live.back() == static_cast<int>(i));
+	}
+	CHECK(same_as_built(rule_set, rules, live, input));
+
+	CHECK(rule_set.remove_rule(7));
+	CHECK(!rule_set.remove_rule(7));
+	CHECK(!rule_set.remove_rule(100));
+	live.erase(live.begin() + 7);
+	CHECK(same_as_built(rule_set, rules, live, input));
+
+	// The new rule has the lowest priority, so zzz stays an identifier
+	rules.emplace_back("z+");
+	live.push_back(rule_set.add_rule("z+"));
+	CHECK(live.back() == static_cast<int>(rules.size()) - 1);
+	CHECK(same_as_built(rule_set, rules, live, input));
+
+	stop = true;
+	reader.join();
+
+	for (auto id : live) CHECK(rule_set.remove_rule(id));
+	CHECK(rule_set.dfa() == nullptr);
+}
+
+}
+
+int main()
+{
+	test_changes();
+
+	return check_result();
+}
@@ -0,0 +1,286 @@
+#include "scanner.h"
+#include "token_handlers.h"
+#include "dfa.h"
+#include "regex.h"
+#include "regex_tree.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * The tokens as `id:lexeme` separated by spaces.
+ */
+std::string describe(const std::string& input, const std::vector<Token>& tokens)
+{
+	std::string result;
+	for (const auto& token : tokens)
+	{
+		if (!result.empty()) result += ' ';
+		result += std::to_string(token.token_id) + ':' + input.substr(token.offset, token.length);
+	}
+	return result;
+}
+
+/**
+ * Random inputs of up to max_length bytes of an alphabet.
+ */
+std::vector<std::string> random_inputs(std::size_t count, std::size_t max_length, const std::string& alphabet)
+{
+	std::mt19937 random(1);
+	std::vector<std::string> inputs(count);
+	for (auto& input : inputs)
+	{
+		auto length = random() % (max_length + 1);
+		for (std::size_t i = 0; i < length; ++i)
+		{
+			input += alphabet[random() % alphabet.length()];
+		}
+	}
+	return inputs;
+}
+
+const char* const program_rules =
+	"[a-zA-Z_][a-zA-Z0-9_]*)#|([0-9]+)#|([ \\t]+)#|(=)#|(==)#|(\\()#|(\\))#|"
+	"(\"[^\"]*\")#|([0-9]+\\.[0-9]+";
+const char* const program_alphabet = "abcXYZ_019 .=()\"\t#";
+
+void test_start_conditions()
+{
+	// Identifiers and blanks outside strings, the quotes switching between
+	// the start conditions
+	AugmentedRegexTree tree(AugmentedRegex(
+		"[a-z]+)#|([ ]+)#|(\")#|([^\"\\\\]+)#|(\")#|(\\\\[\"\\\\]"));
+	const std::string input = "ab \"x y\\\"z\" cd";
+
+	for (bool minimized : {false, true})
+	{
+		for (unsigned int threads : {1u, 3u})
+		{
+			DFA dfa(tree, {{0, 1, 2}, {3, 4, 5}}, threads);
+			if (minimized) dfa.minimize();
+			CHECK(dfa.start_conditions_count() == 2);
+
+			Scanner scanner(dfa);
+			std::vector<Token> tokens;
+			Token token;
+			for (std::size_t offset = 0; offset < input.length(); offset += token.length)
+			{
+				if (!scanner.match(input, offset, token)) break;
+				tokens.push_back(token);
+
+				if (token.token_id == 2) scanner.set_start_condition(1);
+				if (token.token_id == 4) scanner.set_start_condition(0);
+			}
+			CHECK(describe(input, tokens) == "0:ab 1:  2:\" 3:x y 5:\\\" 3:z 4:\" 1:  0:cd");
+		}
+	}
+
+	// The rules of a start condition only
+	DFA dfa(tree, {{0, 1, 2}, {3, 4, 5}});
+	Scanner scanner(dfa);
+	scanner.set_start_condition(1);
+	CHECK(describe("ab\"", scanner.tokenize("ab\"")) == "3:ab 4:\"");
+}
+
+void test_tokenize()
+{
+	DFA dfa{AugmentedRegexTree(AugmentedRegex("if)#|([a-z]+)#|([0-9]+)#|( "))};
+	dfa.minimize();
+	Scanner scanner(dfa);
+
+	// The longest match wins, then the first rule
+	const std::string input = "if iff 12x!";
+	CHECK(describe(input, scanner.tokenize(input)) == "0:if 3:  1:iff 3:  2:12 1:x -1:!");
+}
+
+void test_tokenize_batch()
+{
+	DFA dfa{AugmentedRegexTree(AugmentedRegex(program_rules))};
+	dfa.minimize();
+	Scanner scanner(dfa);
+
+	// Lanes run out of inputs at different times, and the last batch is
+	// not full
+	auto inputs = random_inputs(1003, 40, program_alphabet);
+	auto batch = scanner.tokenize_batch(inputs);
+
+	CHECK(batch.size() == inputs.size());
+	bool same = batch.size() == inputs.size();
+	for (std::size_t i = 0; same && i < inputs.size(); ++i)
+	{
+		same = batch[i] == scanner.tokenize(inputs[i]);
+	}
+	CHECK(same);
+
+	CHECK(scanner.tokenize_batch({}).empty());
+}
+
+void test_scan()
+{
+	enum { IDENTIFIER, NUMBER, BLANK, COMMENT, STRING };
+
+	DFA dfa{AugmentedRegexTree(AugmentedRegex(
+		"[a-z_][a-z0-9_]*)#|([0-9]+)#|([ \\n]+)#|(/\\*[^*]*\\*/)#|(\"[^\"]*\""))};
+	dfa.minimize();
+	Scanner scanner(dfa);
+
+	std::mt19937 random(1);
+	const char* const parts[] = {"foo ", "12 ", "/* c */", "\"str\" ", "bar_9\n", "@"};
+	std::string input;
+	for (int i = 0; i < 10000; ++i) input += parts[random() % 6];
+
+	auto tokens = scanner.tokenize(input);
+
+	// Every token is passed to the handler, in order
+	std::vector<Token> scanned;
+	scanner.scan(input, [&scanned](const Token& token) { scanned.push_back(token); });
+	CHECK(scanned == tokens);
+
+	// The skipped tokens are not, unmatched bytes always are
+	std::vector<Token> kept;
+	for (const auto& token : tokens)
+	{
+		if (token.token_id != BLANK && token.token_id != COMMENT) kept.push_back(token);
+	}
+	scanned.clear();
+	scanner.scan<BLANK, COMMENT>(input, [&scanned](const Token& token) { scanned.push_back(token); });
+	CHECK(scanned == kept);
+
+	// A handler per token id, the others ignored
+	std::size_t identifiers = 0, numbers = 0, unmatched = 0;
+	scanner.scan<BLANK, COMMENT>(input, make_token_handlers<IDENTIFIER, NUMBER, -1>(
+		[&identifiers](const Token&) { ++identifiers; },
+		[&numbers](const Token&) { ++numbers; },
+		[&unmatched](const Token&) { ++unmatched; }));
+
+	std::size_t expected_identifiers = 0, expected_numbers = 0, expected_unmatched = 0;
+	for (const auto& token : tokens)
+	{
+		expected_identifiers += token.token_id == IDENTIFIER;
+		expected_numbers += token.token_id == NUMBER;
+		expected_unmatched += token.token_id == -1;
+	}
+	CHECK(identifiers == expected_identifiers && identifiers > 0);
+	CHECK(numbers == expected_numbers && numbers > 0);
+	CHECK(unmatched == expected_unmatched && unmatched > 0);
+}
+
+void test_stream()
+{
+	DFA dfa{AugmentedRegexTree(AugmentedRegex(
+		"[a-zA-Z_][a-zA-Z0-9_]*)#|([0-9]+(\\.[0-9]+)?)#|([ \\t\\n]+)#|"
+		"(\"([^\"\\\\]|\\\\.)*\")#|(ab|abcd)#|([-+*/=<>!;,.(){}]"))};
+	dfa.minimize();
+
+	// Tokens running over many chunks, and bytes no rule matches
+	std::mt19937 random(7);
+	const std::string alphabet = "abcd xyz 0123.45 \"q\\\"\" +-(){} \n\t@#";
+	std::string input;
+	for (int i = 0; i < 200000; ++i) input += alphabet[random() % alphabet.length()];
+	auto expected = Scanner(dfa).tokenize(input);
+
+	for (std::size_t max_chunk : {1, 7, 5000})
+	{
+		Scanner scanner(dfa);
+		std::vector<Token> tokens;
+		auto handler = [&tokens](const Token& token) { tokens.push_back(token); };
+
+		bool resumed = true;
+		for (std::size_t pos = 0; pos < input.length();)
+		{
+			auto length = std::min<std::size_t>(random() % max_chunk + 1, input.length() - pos);
+			scanner.feed(input.substr(pos, length), handler);
+			pos += length;
+
+			// Resume from a serialized checkpoint, as after a restart
+			if (random() % 5 == 0)
+			{
+				auto checkpoint = Scanner::Checkpoint::deserialize(scanner.checkpoint().serialize());
+				resumed = resumed && checkpoint.offset + checkpoint.lexeme.length() == pos;
+
+				Scanner restored(dfa);
+				restored.restore(checkpoint);
+				scanner = restored;
+			}
+		}
+		scanner.finish(handler);
+
+		CHECK(resumed);
+		CHECK(tokens == expected);
+	}
+
+	// The skipped ids of a stream are those of scan()
+	Scanner scanner(dfa);
+	std::vector<Token> tokens;
+	auto handler = [&tokens](const Token& token) { tokens.push_back(token); };
+	for (std::size_t pos = 0; pos < input.length(); pos += 4096)
+	{
+		scanner.feed<2>(input.substr(pos, 4096), handler);
+	}
+	scanner.finish<2>(handler);
+
+	std::vector<Token> scanned;
+	Scanner(dfa).scan<2>(input, [&scanned](const Token& token) { scanned.push_back(token); });
+	CHECK(tokens == scanned);
+}
+
+void test_checkpoint_errors()
+{
+	DFA dfa{AugmentedRegexTree(AugmentedRegex("[a-z]+)#|([0-9]+"))};
+	DFA other{AugmentedRegexTree(AugmentedRegex("[a-z]+"))};
+
+	Scanner scanner(dfa);
+	scanner.feed("12 abc", [](const Token&) { });
+	auto checkpoint = scanner.checkpoint();
+	CHECK(checkpoint.lexeme == "abc" && checkpoint.offset == 3);
+
+	CHECK_THROWS(Scanner(other).restore(checkpoint), std::invalid_argument);
+
+	auto wrong_lexeme = checkpoint;
+	wrong_lexeme.lexeme = "12";
+	CHECK_THROWS(Scanner(dfa).restore(wrong_lexeme), std::invalid_argument);
+
+	auto wrong_condition = checkpoint;
+	wrong_condition.start_condition = 1;
+	CHECK_THROWS(Scanner(dfa).restore(wrong_condition), std::invalid_argument);
+
+	// The lexeme reaches reject_state, as the state does
+	Scanner::Checkpoint rejected{dfa.fingerprint(), 0, DFA::reject_state, 0, "!x"};
+	CHECK_THROWS(Scanner(dfa).restore(rejected), std::invalid_argument);
+
+	auto wrong_state = checkpoint;
+	wrong_state.state = dfa.states_count();
+	CHECK_THROWS(Scanner(dfa).restore(wrong_state), std::invalid_argument);
+
+	auto data = checkpoint.serialize();
+	CHECK_THROWS(Scanner::Checkpoint::deserialize("xx"), std::invalid_argument);
+	CHECK_THROWS(Scanner::Checkpoint::deserialize(data.substr(0, data.length() - 1)), std::invalid_argument);
+	CHECK_THROWS(Scanner::Checkpoint::deserialize(data.substr(0, 10)), std::invalid_argument);
+
+	// Streams need a DFA
+	PositionAutomaton nfa{AugmentedRegexTree(AugmentedRegex("[a-z]+"))};
+	Scanner nfa_scanner(nfa);
+	CHECK_THROWS(nfa_scanner.feed("abc", [](const Token&) { }), std::logic_error);
+	CHECK_THROWS(nfa_scanner.checkpoint(), std::logic_error);
+}
+
+}
+
+int main()
+{
+	test_start_conditions();
+	test_tokenize();
+	test_tokenize_batch();
+	test_scan();
+	test_stream();
+	test_checkpoint_errors();
+
+	return check_result();
+}
@@ -0,0 +1,195 @@
+#include "searcher.h"
+#include "scanner.h"
+#include "dfa.h"
+#include "regex.h"
+#include "regex_tree.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * The matches found by trying a match at every offset.
+ */
+std::vector<Token> naive_find_all(const Scanner& scanner, const std::string& input)
+{
+	std::vector<Token> tokens;
+	Token token;
+	for (std::size_t offset = 0; offset < input.length();)
+	{
+		if (scanner.match(input, offset, token))
+		{
+			tokens.emplace_back(token);
+			offset += token.length;
+		}
+		else
+		{
+			++offset;
+		}
+	}
+	return tokens;
+}
+
+/**
+ * Random lowercase text with some words of the rules spread over it.
+ */
+std::string log_text()
+{
+	std::mt19937 random(3);
+	const std::string alphabet = "abcdefghijklmnopqrstuvwxyz    ";
+	std::string text;
+	for (int i = 0; i < 200000; ++i) text += alphabet[random() % alphabet.length()];
+	for (int i = 0; i < 100; ++i)
+	{
+		auto pos = random() % (text.length() - 120);
+		text.replace(pos, 9, "error1234");
+		text.replace(pos + 100, 6, "failed");
+	}
+	return text;
+}
+
+const char* const patterns[] = {
+	"error[0-9]+", "[0-9]+(\\.[0-9]+)?", "a|bc", "(x|y)z+", "(ab|cd)*e", "fatal|failed", "abcd|bc", "a*b",
+	"fai)(led"};
+
+void test_prefix()
+{
+	CHECK(Searcher(DFA{AugmentedRegexTree(AugmentedRegex("error[0-9]+"))}).prefix() == "error");
+	CHECK(Searcher(DFA{AugmentedRegexTree(AugmentedRegex("fatal|failed"))}).prefix() == "fa");
+	CHECK(Searcher(DFA{AugmentedRegexTree(AugmentedRegex("a|bc"))}).prefix().empty());
+	// A match may end after a
+	CHECK(Searcher(DFA{AugmentedRegexTree(AugmentedRegex("ab?"))}).prefix() == "a");
+}
+
+void test_prefilter()
+{
+	auto text = log_text();
+	for (auto pattern : patterns)
+	{
+		DFA dfa{AugmentedRegexTree(AugmentedRegex(pattern))};
+		dfa.minimize();
+		Searcher searcher(dfa);
+		Scanner scanner(dfa);
+
+		auto expected = naive_find_all(scanner, text);
+		CHECK(searcher.find_all(text) == expected);
+
+		// The leftmost match from an offset inside the text
+		Token token;
+		Token expected_token;
+		std::size_t offset = 12345;
+		while (offset < text.length() && !scanner.match(text, offset, expected_token)) ++offset;
+		bool found = searcher.find(text, 12345, token);
+		CHECK(found == (offset < text.length()));
+		CHECK(!found || (token.offset == expected_token.offset && token.length == expected_token.length));
+	}
+}
+
+void test_reversed_rules()
+{
+	// Every string of up to 5 bytes over an alphabet covering the rules
+	std::vector<std::string> strings{""};
+	for (std::size_t i = 0; i < strings.size() && strings[i].length() < 5; ++i)
+	{
+		for (char c : std::string("abcdex"))
+		{
+			strings.emplace_back(strings[i] + c);
+		}
+	}
+	strings.emplace_back("éü");
+	strings.emplace_back("éÿ");
+
+	// The last rules are not parenthesized as a whole, so their `#` ends a
+	// chain of concatenations
+	for (auto pattern : {"ab(c|d)*e", "[a-c]{2,3}x?", "(ab|cd)+", "é[ü-ÿ]", "abcd|bc",
+	                     "a)(b", "ab)#|(c)(de"})
+	{
+		AugmentedRegexTree tree{AugmentedRegex(pattern)};
+		DFA dfa(tree);
+		DFA reverse_dfa(tree.reversed());
+		reverse_dfa.minimize();
+
+		bool same = true;
+		for (const auto& str : strings)
+		{
+			same = same && dfa.matches(str) == reverse_dfa.matches(std::string(str.rbegin(), str.rend()));
+		}
+		CHECK(same);
+	}
+}
+
+void test_reverse_search()
+{
+	auto text = log_text();
+	for (auto pattern : patterns)
+	{
+		AugmentedRegexTree tree{AugmentedRegex(pattern)};
+		DFA dfa(tree);
+		DFA reverse_dfa(tree.reversed(true));
+		dfa.minimize();
+		reverse_dfa.minimize();
+		Searcher searcher(dfa, reverse_dfa);
+		Scanner scanner(dfa);
+
+		CHECK(searcher.find_all(text) == naive_find_all(scanner, text));
+
+		Token token;
+		Token expected_token;
+		CHECK(searcher.find(text, 12345, token) == Searcher(dfa).find(text, 12345, expected_token));
+		CHECK(token.offset == expected_token.offset && token.length == expected_token.length);
+	}
+}
+
+void test_reverse_search_time()
+{
+	// Every a starts a match of a, and the forward scan from it runs to the
+	// end of the input looking for the b of a*b: the scans from successive
+	// offsets are in the same state, so each of them stops after a byte
+	// instead of making the search quadratic
+	AugmentedRegexTree tree{AugmentedRegex("a)#|(a*b")};
+	DFA dfa(tree);
+	DFA reverse_dfa(tree.reversed(true));
+	Searcher searcher(dfa, reverse_dfa);
+
+	const std::string input(1000000, 'a');
+	auto tokens = searcher.find_all(input);
+	CHECK(tokens.size() == input.length());
+	CHECK(tokens.back().token_id == 0 && tokens.back().length == 1);
+
+	// The match of a*b is still found past the scans stopped early
+	auto with_b = input + 'b';
+	tokens = searcher.find_all(with_b);
+	CHECK(tokens.size() == 1 && tokens[0].token_id == 1 && tokens[0].length == with_b.length());
+
+	auto small = std::string(100, 'a') + "ba" + std::string(100, 'a');
+	CHECK(searcher.find_all(small) == naive_find_all(Scanner(dfa), small));
+	// The successive calls of find() on an input scan it backwards once
+	DFA single{AugmentedRegexTree(AugmentedRegex("a"))};
+	DFA single_reverse{AugmentedRegexTree(AugmentedRegex("a")).reversed(true)};
+	Searcher single_searcher(single, single_reverse);
+	std::size_t found = 0;
+	Token token;
+	for (std::size_t offset = 0; single_searcher.find(input, offset, token); offset = token.offset + 1)
+	{
+		++found;
+	}
+	CHECK(found == input.length());
+}
+
+}
+
+int main()
+{
+	test_prefix();
+	test_prefilter();
+	test_reversed_rules();
+	test_reverse_search();
+	test_reverse_search_time();
+
+	return check_result();
+}
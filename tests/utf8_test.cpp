@@ -0,0 +1,121 @@
+#include "utf8.h"
+#include "dfa.h"
+#include "regex.h"
+#include "regex_tree.h"
+
+#include <string>
+
+#include "check.h"
+
+namespace
+{
+
+/**
+ * The length of the longest prefix of a string accepted by a DFA.
+ * @param token_id set to the token id of the prefix
+ * @return the length, -1 if no prefix is accepted
+ */
+int longest_match(const DFA& dfa, const std::string& str, int& token_id)
+{
+	int state = dfa.start_state();
+	int length = -1;
+	token_id = -1;
+	for (std::size_t i = 0; state != DFA::reject_state; ++i)
+	{
+		if (dfa.token_id(state) != -1)
+		{
+			length = i;
+			token_id = dfa.token_id(state);
+		}
+		if (i == str.length()) break;
+		state = dfa.next(state, static_cast<unsigned char>(str[i]));
+	}
+	return length;
+}
+
+void test_encode_decode()
+{
+	for (char32_t code_point : {0x0u, 0x41u, 0x7Fu, 0x80u, 0x3B1u, 0x7FFu, 0x800u,
+	                            0xD7FFu, 0xE000u, 0x20ACu, 0xFFFFu, 0x10000u, 0x1F600u, 0x10FFFFu})
+	{
+		auto encoded = utf8::encode(code_point);
+		CHECK(utf8::sequence_length(encoded, 0) == encoded.length());
+
+		std::size_t pos = 0;
+		CHECK(utf8::decode(encoded, pos) == code_point);
+		CHECK(pos == encoded.length());
+	}
+
+	// Invalid bytes are decoded one by one as themselves
+	std::string invalid("\xC0\x80\xE2\x82");
+	std::size_t pos = 0;
+	CHECK(utf8::decode(invalid, pos) == 0xC0 && pos == 1);
+	CHECK(utf8::sequence_length(invalid, 2) == 1);
+
+	// Overlong encodings and surrogates too
+	for (const std::string overlong : {"\xE0\x80\x80", "\xE0\x9F\xBF", "\xED\xA0\x80",
+	                                   "\xED\xBF\xBF", "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80"})
+	{
+		CHECK(utf8::sequence_length(overlong, 0) == 1);
+	}
+}
+
+void test_byte_sequences()
+{
+	CHECK(utf8::byte_sequences(0x41, 0x5A).size() == 1);
+	CHECK_THROWS(utf8::byte_sequences(0x5A, 0x41), std::invalid_argument);
+	CHECK_THROWS(utf8::byte_sequences(0, 0x110000), std::invalid_argument);
+
+	// Every code point around and inside the ranges is matched iff it is in
+	// the range
+	for (char32_t first : {0x7Fu, 0x80u, 0x3B1u, 0x800u, 0xD7FFu, 0xE000u, 0xFFFDu, 0x10000u})
+	{
+		auto last = first + 5000;
+		auto range = utf8::encode(first) + "-" + utf8::encode(last);
+		DFA dfa{AugmentedRegexTree(AugmentedRegex(range))};
+		dfa.minimize();
+
+		for (auto code_point = first - 1; code_point <= last + 1; ++code_point)
+		{
+			if (code_point >= 0xD800 && code_point <= 0xDFFF) continue;
+
+			auto encoded = utf8::encode(code_point);
+			int token_id;
+			bool matched = longest_match(dfa, encoded, token_id) == static_cast<int>(encoded.length());
+			CHECK(matched == (code_point >= first && code_point <= last));
+		}
+	}
+}
+
+void test_code_point_rules()
+{
+	AugmentedRegexTree tree(AugmentedRegex(
+		"(a-z|α-ω)(a-z|α-ω|0-9)*)#|((0-9)(0-9)*)#|(€)#|( )#|(\xC2\x80-\xF4\x8F\xBF\xBF"));
+
+	for (bool minimized : {false, true})
+	{
+		DFA dfa(tree);
+		if (minimized) dfa.minimize();
+
+		int token_id;
+		CHECK(longest_match(dfa, "abc9 x", token_id) == 4 && token_id == 0);
+		CHECK(longest_match(dfa, "αβγ", token_id) == 6 && token_id == 0);
+		CHECK(longest_match(dfa, "123a", token_id) == 3 && token_id == 1);
+		CHECK(longest_match(dfa, "€", token_id) == 3 && token_id == 2);
+		CHECK(longest_match(dfa, "😀", token_id) == 4 && token_id == 4);
+		CHECK(longest_match(dfa, "ϊ", token_id) == 2 && token_id == 4);
+		// A surrogate has no UTF-8 encoding
+		CHECK(longest_match(dfa, "\xED\xA0\x80", token_id) == -1);
+	}
+}
+
+}
+
+int main()
+{
+	test_encode_decode();
+	test_byte_sequences();
+	test_code_point_rules();
+
+	return check_result();
+}
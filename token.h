@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * A token found by a Scanner.
+ */
+struct Token
+{
+	int token_id; /**< The id of the rule, -1 for bytes not matched by any rule */
+	std::size_t offset; /**< The offset of the lexeme in the input */
+	std::size_t length; /**< The length of the lexeme */
+};
+
+/**
+ * Whether two tokens are the same lexeme of the same rule.
+ */
+inline bool operator==(const Token& first, const Token& second)
+{
+	return first.token_id == second.token_id &&
+	       first.offset == second.offset &&
+	       first.length == second.length;
+}
+
+inline bool operator!=(const Token& first, const Token& second)
+{
+	return !(first == second);
+}
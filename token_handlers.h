@@ -0,0 +1,60 @@
+#pragma once
+
+#include <tuple>
+#include <utility>
+
+#include "token.h"
+
+/**
+ * A handler for Scanner::scan() calling the handler of the id of each
+ * token. The ids are template parameters, so the choice of the handler is
+ * a chain of comparisons with constants, inlined with the handlers into
+ * the scan loop. The tokens of other ids are ignored.
+ */
+template<typename Ids, typename... Handlers>
+class TokenHandlers;
+
+template<int... Ids, typename... Handlers>
+class TokenHandlers<std::integer_sequence<int, Ids...>, Handlers...>
+{
+	static_assert(sizeof...(Ids) == sizeof...(Handlers),
+	              "there must be a handler for each token id");
+
+public:
+	explicit TokenHandlers(Handlers... handlers)
+		: _handlers(std::move(handlers)...)
+	{ }
+
+	void operator()(const Token& token)
+	{ call<0, Ids...>(token); }
+
+private:
+	template<std::size_t I>
+	void call(const Token&)
+	{ }
+
+	template<std::size_t I, int Id, int... OtherIds>
+	void call(const Token& token)
+	{
+		if (token.token_id == Id)
+			std::get<I>(_handlers)(token);
+		else
+			call<I + 1, OtherIds...>(token);
+	}
+
+
+	std::tuple<Handlers...> _handlers;
+};
+
+/**
+ * Make a handler calling a handler per token id, for example
+ * make_token_handlers<IDENTIFIER, NUMBER>(on_identifier, on_number).
+ * @tparam Ids the token id of each handler, -1 for unmatched bytes
+ * @param handlers callables taking a const Token&
+ */
+template<int... Ids, typename... Handlers>
+TokenHandlers<std::integer_sequence<int, Ids...>, Handlers...>
+make_token_handlers(Handlers... handlers)
+{
+	return TokenHandlers<std::integer_sequence<int, Ids...>, Handlers...>(std::move(handlers)...);
+}
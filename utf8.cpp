@@ -0,0 +1,158 @@
+#include "utf8.h"
+
+#include <stdexcept>
+
+namespace utf8
+{
+
+namespace
+{
+
+std::size_t encoded_length(char32_t code_point)
+{
+	if (code_point <= 0x7F) return 1;
+	if (code_point <= 0x7FF) return 2;
+	if (code_point <= 0xFFFF) return 3;
+	return 4;
+}
+
+}
+
+std::size_t sequence_length(const std::string& str, std::size_t pos)
+{
+	auto lead = static_cast<unsigned char>(str[pos]);
+
+	std::size_t length = 1;
+	if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+	else if (lead >= 0xE0 && lead <= 0xEF) length = 3;
+	else if (lead >= 0xF0 && lead <= 0xF4) length = 4;
+
+	if (pos + length > str.length()) return 1;
+
+	// The second byte excludes the overlong encodings and the surrogates
+	auto second = static_cast<unsigned char>(str[pos + 1]);
+	if ((lead == 0xE0 && second < 0xA0) || (lead == 0xED && second > 0x9F) ||
+	    (lead == 0xF0 && second < 0x90) || (lead == 0xF4 && second > 0x8F))
+		return 1;
+
+	for (std::size_t i = 1; i < length; ++i)
+	{
+		if ((static_cast<unsigned char>(str[pos + i]) & 0xC0) != 0x80) return 1;
+	}
+	return length;
+}
+
+char32_t decode(const std::string& str, std::size_t& pos)
+{
+	auto length = sequence_length(str, pos);
+	auto lead = static_cast<unsigned char>(str[pos]);
+
+	char32_t code_point = length == 1 ? lead : lead & (0x7F >> length);
+	for (std::size_t i = 1; i < length; ++i)
+	{
+		code_point = (code_point << 6) | (str[pos + i] & 0x3F);
+	}
+	pos += length;
+	return code_point;
+}
+
+std::string encode(char32_t code_point)
+{
+	std::string result;
+	switch (encoded_length(code_point))
+	{
+		case 1:
+			result += static_cast<char>(code_point);
+			break;
+		case 2:
+			result += static_cast<char>(0xC0 | (code_point >> 6));
+			result += static_cast<char>(0x80 | (code_point & 0x3F));
+			break;
+		case 3:
+			result += static_cast<char>(0xE0 | (code_point >> 12));
+			result += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+			result += static_cast<char>(0x80 | (code_point & 0x3F));
+			break;
+		default:
+			result += static_cast<char>(0xF0 | (code_point >> 18));
+			result += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+			result += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+			result += static_cast<char>(0x80 | (code_point & 0x3F));
+	}
+	return result;
+}
+
+std::vector<byte_sequence> byte_sequences(char32_t first, char32_t last)
+{
+	if (first > last || last > max_code_point)
+		throw std::invalid_argument("invalid code point range");
+
+	std::vector<byte_sequence> result;
+
+	// Ranges still to be split; the lower half is pushed last so the
+	// sequences come out in ascending order
+	std::vector<std::pair<char32_t, char32_t>> stack{{first, last}};
+	while (!stack.empty())
+	{
+		auto lo = stack.back().first;
+		auto hi = stack.back().second;
+		stack.pop_back();
+
+		// Surrogates have no UTF-8 encoding
+		if (lo <= 0xDFFF && hi >= 0xD800)
+		{
+			if (hi > 0xDFFF) stack.emplace_back(0xE000, hi);
+			if (lo < 0xD800) stack.emplace_back(lo, 0xD7FF);
+			continue;
+		}
+
+		// Both ends must have the same encoded length
+		if (encoded_length(lo) != encoded_length(hi))
+		{
+			char32_t max = encoded_length(lo) == 1 ? 0x7F :
+			               encoded_length(lo) == 2 ? 0x7FF : 0xFFFF;
+			stack.emplace_back(max + 1, hi);
+			stack.emplace_back(lo, max);
+			continue;
+		}
+
+		// Every continuation byte must cover either a single value or
+		// its whole range, otherwise the product of the ranges would
+		// match code points outside [lo, hi]
+		bool split = false;
+		for (std::size_t i = 1; i < encoded_length(lo) && !split; ++i)
+		{
+			char32_t mask = (1u << (6 * i)) - 1;
+			if ((lo & ~mask) == (hi & ~mask)) continue;
+
+			if ((lo & mask) != 0)
+			{
+				stack.emplace_back((lo | mask) + 1, hi);
+				stack.emplace_back(lo, lo | mask);
+				split = true;
+			}
+			else if ((hi & mask) != mask)
+			{
+				stack.emplace_back(hi & ~mask, hi);
+				stack.emplace_back(lo, (hi & ~mask) - 1);
+				split = true;
+			}
+		}
+		if (split) continue;
+
+		auto lo_bytes = encode(lo);
+		auto hi_bytes = encode(hi);
+
+		byte_sequence sequence;
+		for (std::size_t i = 0; i < lo_bytes.length(); ++i)
+		{
+			sequence.emplace_back(static_cast<unsigned char>(lo_bytes[i]),
+			                      static_cast<unsigned char>(hi_bytes[i]));
+		}
+		result.emplace_back(std::move(sequence));
+	}
+
+	return result;
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+
+namespace utf8
+{
+
+using byte_range = std::pair<unsigned char, unsigned char>;
+using byte_sequence = std::vector<byte_range>;
+
+/**
+ * The largest valid code point.
+ */
+constexpr char32_t max_code_point = 0x10FFFF;
+
+/**
+ * Length of the UTF-8 sequence starting at a given position.
+ * @param str the encoded string
+ * @param pos the position of the leading byte
+ * @return the sequence length, or 1 if the bytes are not valid UTF-8,
+ * overlong encodings and surrogates included
+ */
+std::size_t sequence_length(const std::string& str, std::size_t pos);
+
+/**
+ * Decode the UTF-8 sequence starting at a given position.
+ * @param str the encoded string
+ * @param pos the position of the leading byte, moved past the sequence
+ * @return the decoded code point, or the byte itself if it is not valid UTF-8
+ */
+char32_t decode(const std::string& str, std::size_t& pos);
+
+/**
+ * Encode a code point as UTF-8.
+ */
+std::string encode(char32_t code_point);
+
+/**
+ * Split a range of code points into sequences of byte ranges, such that a
+ * string of bytes is the UTF-8 encoding of a code point in the range iff it
+ * matches one of the sequences. Surrogates are excluded.
+ * @param first the first code point of the range
+ * @param last the last code point of the range
+ * @return the sequences in ascending order
+ */
+std::vector<byte_sequence> byte_sequences(char32_t first, char32_t last);
+
+}
@@ -1,14 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
 namespace utility
 {
 
+/**
+ * The union of two sorted vectors without duplicates.
+ */
 template<typename T>
-T union_sets(const T& s1, const T& s2)
+std::vector<T> union_sets(const std::vector<T>& s1, const std::vector<T>& s2)
 {
-	T result = s1;
+	std::vector<T> result;
+	result.reserve(s1.size() + s2.size());
 
-	result.insert(s2.cbegin(), s2.cend());
+	std::set_union(s1.cbegin(), s1.cend(),
+	               s2.cbegin(), s2.cend(),
+	               std::back_inserter(result));
 
 	return result;
 }
 
+/**
+ * Heap bytes held by a vector of trivially copyable elements.
+ */
+template<typename T>
+std::size_t memory_bytes(const std::vector<T>& vector)
+{
+	return vector.capacity() * sizeof(T);
+}
+
 }
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+
+/**
+ * A queue of work items shared by a fixed number of workers. Each worker
+ * has its own deque: it takes the items it pushed last first, and steals
+ * the oldest items of the other workers when its deque is empty.
+ */
+template<typename T>
+class WorkStealingQueue
+{
+public:
+	/**
+	 * @param workers the number of workers
+	 */
+	explicit WorkStealingQueue(std::size_t workers)
+		: _deques(workers), _pending(0)
+	{
+		for (auto& deque : _deques)
+		{
+			deque = std::make_unique<Deque>();
+		}
+	}
+
+	/**
+	 * Add an item to the deque of a worker.
+	 * @param worker the id of the worker
+	 * @param item the item to add
+	 */
+	void push(std::size_t worker, T item)
+	{
+		++_pending;
+		std::lock_guard<std::mutex> lock(_deques[worker]->mutex);
+		_deques[worker]->items.emplace_back(std::move(item));
+	}
+
+	/**
+	 * Take an item, waiting while other workers may still push new ones.
+	 * Each item taken must be reported with done() once processed.
+	 * @param worker the id of the worker
+	 * @param item the taken item
+	 * @return false when all the items have been processed
+	 */
+	bool pop(std::size_t worker, T& item)
+	{
+		while (_pending > 0)
+		{
+			if (take_back(worker, item)) return true;
+
+			for (std::size_t i = 1; i < _deques.size(); ++i)
+			{
+				if (take_front((worker + i) % _deques.size(), item)) return true;
+			}
+
+			std::this_thread::yield();
+		}
+		return false;
+	}
+
+	/**
+	 * Report that a taken item has been processed.
+	 */
+	void done()
+	{ --_pending; }
+
+private:
+	struct Deque
+	{
+		std::mutex mutex;
+		std::deque<T> items;
+	};
+
+
+	bool take_back(std::size_t worker, T& item)
+	{
+		std::lock_guard<std::mutex> lock(_deques[worker]->mutex);
+		if (_deques[worker]->items.empty()) return false;
+
+		item = std::move(_deques[worker]->items.back());
+		_deques[worker]->items.pop_back();
+		return true;
+	}
+
+	bool take_front(std::size_t worker, T& item)
+	{
+		std::lock_guard<std::mutex> lock(_deques[worker]->mutex);
+		if (_deques[worker]->items.empty()) return false;
+
+		item = std::move(_deques[worker]->items.front());
+		_deques[worker]->items.pop_front();
+		return true;
+	}
+
+
+	std::vector<std::unique_ptr<Deque>> _deques; /**< The deque of each worker */
+	std::atomic<std::size_t> _pending; /**< Items pushed and not done yet */
+};